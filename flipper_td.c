@@ -1,5 +1,27 @@
 #include "flipper_td.h"
 
+// Spawn and exit layouts, selected at build time with MAP_LAYOUT
+static const MapLayout map_layouts[] = {
+    {
+        .name = "corner",
+        .spawn_count = 1,
+        .exit_count = 1,
+        .spawns = {{0, 0}},
+        .exits = {{GRID_WIDTH - 1, GRID_HEIGHT - 1}},
+    },
+    {
+        .name = "crossing",
+        .spawn_count = 2,
+        .exit_count = 2,
+        .spawns = {{0, 0}, {0, GRID_HEIGHT - 1}},
+        .exits = {{GRID_WIDTH - 1, GRID_HEIGHT - 1}, {GRID_WIDTH - 1, 0}},
+    },
+};
+
+_Static_assert(
+    MAP_LAYOUT >= 0 && MAP_LAYOUT < (int)(sizeof(map_layouts) / sizeof(map_layouts[0])),
+    "unknown MAP_LAYOUT");
+
 /**
  * @brief Helper function to convert 2D grid coordinates to a 1D array index.
  * @param x The x-coordinate on the grid.
@@ -10,6 +32,153 @@ static inline int idx(int x, int y) {
     return x * GRID_HEIGHT + y;
 }
 
+/**
+ * @brief Helper function to convert a 1D array index back to grid coordinates.
+ * @param cell The 1D array index.
+ * @return The corresponding grid coordinate.
+ */
+static inline Coord cell_coord(int cell) {
+    return (Coord){cell / GRID_HEIGHT, cell % GRID_HEIGHT};
+}
+
+/**
+ * @brief Reads the packed 4-bit value of a grid cell.
+ * @param game Pointer to the current game state.
+ * @param cell The 1D cell index.
+ * @return The TowerType in the low bits, CELL_FLAG_* in the high bit.
+ */
+static inline uint8_t grid_packed(const GameState* game, int cell) {
+    return (game->grid[cell / 2] >> ((cell % 2) * 4)) & 0x0F;
+}
+
+/**
+ * @brief Writes the packed 4-bit value of a grid cell.
+ * @param game Pointer to the current game state.
+ * @param cell The 1D cell index.
+ * @param value The TowerType and CELL_FLAG_* bits to store.
+ */
+static inline void grid_set_packed(GameState* game, int cell, uint8_t value) {
+    int shift = (cell % 2) * 4;
+    game->grid[cell / 2] = (game->grid[cell / 2] & ~(0x0F << shift)) | (value << shift);
+}
+
+/**
+ * @brief Returns the tower in a grid cell.
+ * @param game Pointer to the current game state.
+ * @param cell The 1D cell index.
+ * @return The tower type, TOWER_NONE for a free cell.
+ */
+static inline TowerType grid_tower(const GameState* game, int cell) {
+    return (TowerType)(grid_packed(game, cell) & CELL_TYPE_MASK);
+}
+
+/**
+ * @brief Empties a scratch arena and clears its peak.
+ * @param arena The arena to reset.
+ */
+void scratch_reset(ScratchArena* arena) {
+    arena->used = 0;
+    arena->peak = 0;
+}
+
+/**
+ * @brief Takes word-aligned working memory from a scratch arena.
+ *
+ * Running out means SCRATCH_ARENA_SIZE no longer covers the largest user, which is a build
+ * error rather than a runtime condition, so it is checked instead of reported.
+ * @param arena The arena to allocate from.
+ * @param size The number of bytes needed.
+ * @return The memory, valid until the arena is released to an earlier mark.
+ */
+void* scratch_alloc(ScratchArena* arena, size_t size) {
+    size = (size + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+    furi_check(size <= sizeof(arena->bytes) - arena->used);
+    void* memory = (uint8_t*)arena->bytes + arena->used;
+    arena->used += size;
+    if(arena->used > arena->peak) arena->peak = arena->used;
+    return memory;
+}
+
+/**
+ * @brief Frees everything allocated from a scratch arena since a mark.
+ * @param arena The arena to release.
+ * @param mark The arena's used count when the caller started allocating.
+ */
+void scratch_release(ScratchArena* arena, size_t mark) {
+    arena->used = mark;
+}
+
+/**
+ * @brief Resets a slot pool so that every slot is free.
+ * @param pool The pool to reset.
+ * @param capacity The number of slots, at most SLOT_POOL_MAX.
+ */
+void slot_pool_init(SlotPool* pool, int capacity) {
+    pool->capacity = capacity;
+    pool->live_count = 0;
+    pool->free_head = 0;
+    pool->free_count = capacity;
+    memset(pool->live, 0, sizeof(pool->live));
+    for(int i = 0; i < capacity; i++) {
+        pool->free[i] = i;
+    }
+}
+
+/**
+ * @brief Takes the next free slot and marks it live.
+ * @param pool The pool to allocate from.
+ * @return The acquired slot, or -1 if the pool is full.
+ */
+int slot_pool_acquire(SlotPool* pool) {
+    if(pool->free_count == 0) return -1;
+    int slot = pool->free[pool->free_head];
+    pool->free_head = (pool->free_head + 1) % pool->capacity;
+    pool->free_count--;
+    pool->live[slot / 32] |= 1U << (slot % 32);
+    pool->live_count++;
+    return slot;
+}
+
+/**
+ * @brief Returns a live slot to the pool. Safe to call while walking with slot_pool_next().
+ * @param pool The pool the slot belongs to.
+ * @param slot The live slot to release.
+ */
+void slot_pool_release(SlotPool* pool, int slot) {
+    pool->live[slot / 32] &= ~(1U << (slot % 32));
+    pool->live_count--;
+    pool->free[(pool->free_head + pool->free_count) % pool->capacity] = slot;
+    pool->free_count++;
+}
+
+/**
+ * @brief Checks whether a slot is currently live.
+ * @param pool The pool the slot belongs to.
+ * @param slot The slot to check.
+ * @return True if the slot is live, false otherwise.
+ */
+bool slot_pool_is_live(const SlotPool* pool, int slot) {
+    return pool->live[slot / 32] & (1U << (slot % 32));
+}
+
+/**
+ * @brief Finds the next live slot in ascending order using count-trailing-zeros.
+ * @param pool The pool to walk.
+ * @param after The previous slot, or -1 to start from the beginning.
+ * @return The next live slot, or -1 if there is none.
+ */
+static inline int slot_pool_next(const SlotPool* pool, int after) {
+    int slot = after + 1;
+    int word = slot / 32;
+    if(word >= SLOT_MASK_WORDS) return -1;
+    uint32_t bits = pool->live[word] & (0xFFFFFFFFU << (slot % 32));
+    while(bits == 0) {
+        if(++word >= SLOT_MASK_WORDS) return -1;
+        bits = pool->live[word];
+    }
+    return word * 32 + __builtin_ctz(bits);
+}
+
 /**
  * @brief Calculates the parameters for a given wave number.
  * @param wave_number The current wave number.
@@ -18,7 +187,7 @@ static inline int idx(int x, int y) {
 Wave get_wave_params(int wave_number) {
     Wave w;
     w.wave_number = wave_number;
-    w.enemy_speed = 0.20f + 0.05f * wave_number;
+    w.enemy_speed = SCALAR_FROM_RATIO(20, 100) + SCALAR_FROM_RATIO(5, 100) * wave_number;
     w.enemy_hp = 3 + wave_number;
     w.enemy_count = wave_number + 2;
     if(w.enemy_count > MAX_ENEMIES) w.enemy_count = MAX_ENEMIES;
@@ -52,7 +221,8 @@ TowerType next_tower_type(TowerType current) {
 }
 
 /**
- * @brief Finds the shortest path from a start to an end coordinate using Breadth-First Search (BFS).
+ * @brief Breadth-First Search behind find_path(). Works in game->scratch, so it never
+ * touches the heap and games on different threads do not share any state.
  * @param game Pointer to the current game state.
  * @param start The starting coordinate.
  * @param end The ending coordinate.
@@ -60,65 +230,310 @@ TowerType next_tower_type(TowerType current) {
  * @param path_length Pointer to an integer to store the length of the path.
  * @return True if a path is found, false otherwise.
  */
-bool find_path(GameState* game, Coord start, Coord end, Coord path[], int* path_length) {
-    int total_cells = GRID_WIDTH * GRID_HEIGHT;
-    bool* visited = malloc(total_cells * sizeof(bool));
-    Coord* parent = malloc(total_cells * sizeof(Coord));
-    Coord* queue = malloc(total_cells * sizeof(Coord));
-    if(!visited || !parent || !queue) {
-        free(visited);
-        free(parent);
-        free(queue);
-        return false;
+static bool
+    find_path_bfs(GameState* game, Coord start, Coord end, Coord path[], int* path_length) {
+    size_t mark = game->scratch.used;
+    uint16_t* queue = scratch_alloc(&game->scratch, GRID_CELLS * sizeof(uint16_t));
+    // Cell each cell was reached from, or FLOW_UNREACHABLE
+    uint16_t* parent = scratch_alloc(&game->scratch, GRID_CELLS * sizeof(uint16_t));
+    for(int i = 0; i < GRID_CELLS; i++) {
+        parent[i] = FLOW_UNREACHABLE;
     }
-    memset(visited, 0, total_cells * sizeof(bool));
+    int first = idx(start.x, start.y);
+    int last = idx(end.x, end.y);
     int front = 0, rear = 0;
-    queue[rear++] = start;
-    visited[idx(start.x, start.y)] = true;
-    parent[idx(start.x, start.y)] = (Coord){-1, -1};
+    queue[rear++] = first;
+    parent[first] = first;
 
     bool found = false;
     while(front < rear) {
-        Coord current = queue[front++];
-        if(current.x == end.x && current.y == end.y) {
+        int cell = queue[front++];
+        if(cell == last) {
             found = true;
             break;
         }
+        Coord current = cell_coord(cell);
         int dx[4] = {1, -1, 0, 0};
         int dy[4] = {0, 0, 1, -1};
         for(int i = 0; i < 4; i++) {
             int nx = current.x + dx[i];
             int ny = current.y + dy[i];
             if(nx < 0 || nx >= GRID_WIDTH || ny < 0 || ny >= GRID_HEIGHT) continue;
-            if(!visited[idx(nx, ny)] && game->grid[nx][ny] == TOWER_NONE) {
-                visited[idx(nx, ny)] = true;
-                parent[idx(nx, ny)] = current;
-                queue[rear++] = (Coord){nx, ny};
+            int n = idx(nx, ny);
+            if(parent[n] == FLOW_UNREACHABLE && grid_tower(game, n) == TOWER_NONE) {
+                parent[n] = cell;
+                queue[rear++] = n;
             }
         }
     }
-    if(!found) {
-        free(visited);
-        free(parent);
-        free(queue);
-        return false;
+    if(found) {
+        int count = 0;
+        for(int cell = last;; cell = parent[cell]) {
+            path[count++] = cell_coord(cell);
+            if(cell == first) break;
+        }
+        for(int i = 0; i < count / 2; i++) {
+            Coord temp = path[i];
+            path[i] = path[count - i - 1];
+            path[count - i - 1] = temp;
+        }
+        *path_length = count;
     }
-    int count = 0;
-    Coord step = end;
-    while(step.x != -1 && step.y != -1) {
-        path[count++] = step;
-        step = parent[idx(step.x, step.y)];
-    }
-    for(int i = 0; i < count / 2; i++) {
-        Coord temp = path[i];
-        path[i] = path[count - i - 1];
-        path[count - i - 1] = temp;
-    }
-    *path_length = count;
-    free(visited);
-    free(parent);
-    free(queue);
-    return true;
+    scratch_release(&game->scratch, mark);
+    return found;
+}
+
+/**
+ * @brief Finds the shortest path from a start to an end coordinate using Breadth-First Search (BFS).
+ * @param game Pointer to the current game state.
+ * @param start The starting coordinate.
+ * @param end The ending coordinate.
+ * @param path An array to be populated with the coordinates of the found path.
+ * @param path_length Pointer to an integer to store the length of the path.
+ * @return True if a path is found, false otherwise.
+ */
+bool find_path(GameState* game, Coord start, Coord end, Coord path[], int* path_length) {
+    uint32_t profile_start = profile_now();
+    bool found = find_path_bfs(game, start, end, path, path_length);
+    profiler_record(&game->profiler, ProfilePath, profile_start);
+    return found;
+}
+
+/**
+ * @brief Reads the tower type stored in a grid cell.
+ * @param game Pointer to the current game state.
+ * @param x The x-coordinate on the grid.
+ * @param y The y-coordinate on the grid.
+ * @return The tower type, TOWER_NONE for a free cell.
+ */
+TowerType get_grid_cell(const GameState* game, int x, int y) {
+    return grid_tower(game, idx(x, y));
+}
+
+/**
+ * @brief Writes a tower type into the grid and invalidates grid-derived caches.
+ * @param game Pointer to the current game state.
+ * @param x The x-coordinate on the grid.
+ * @param y The y-coordinate on the grid.
+ * @param type The tower type to store in the cell. The cell's flags are kept.
+ */
+void set_grid_cell(GameState* game, int x, int y, TowerType type) {
+    int cell = idx(x, y);
+    uint8_t packed = grid_packed(game, cell);
+    if((packed & CELL_TYPE_MASK) == type) return;
+    grid_set_packed(game, cell, (packed & ~CELL_TYPE_MASK) | type);
+    game->grid_generation++;
+}
+
+/**
+ * @brief Rebuilds the flow field toward the exits from the current grid.
+ *
+ * A single BFS seeded with every exit gives each free cell its distance to the nearest exit
+ * and the neighbour to step to next, so all spawns share one field. Cells occupied by towers
+ * point at their closest free neighbour so an enemy caught under a newly placed tower walks
+ * off it instead of getting stuck.
+ * @param game Pointer to the current game state.
+ */
+static void flow_field_build(GameState* game) {
+    FlowField* flow = &game->flow;
+    flow->generation = game->grid_generation;
+
+    for(int i = 0; i < GRID_CELLS; i++) {
+        flow->dist[i] = FLOW_UNREACHABLE;
+        flow->next[i] = i;
+    }
+    size_t mark = game->scratch.used;
+    uint16_t* queue = scratch_alloc(&game->scratch, GRID_CELLS * sizeof(uint16_t));
+    int front = 0, rear = 0;
+    for(int e = 0; e < game->map->exit_count; e++) {
+        int exit = idx(game->map->exits[e].x, game->map->exits[e].y);
+        if(grid_tower(game, exit) != TOWER_NONE || flow->dist[exit] == 0) continue;
+        queue[rear++] = exit;
+        flow->dist[exit] = 0;
+    }
+
+    int dx[4] = {1, -1, 0, 0};
+    int dy[4] = {0, 0, 1, -1};
+    while(front < rear) {
+        int cell = queue[front++];
+        Coord current = cell_coord(cell);
+        for(int i = 0; i < 4; i++) {
+            int nx = current.x + dx[i];
+            int ny = current.y + dy[i];
+            if(nx < 0 || nx >= GRID_WIDTH || ny < 0 || ny >= GRID_HEIGHT) continue;
+            int n = idx(nx, ny);
+            if(flow->dist[n] == FLOW_UNREACHABLE && grid_tower(game, n) == TOWER_NONE) {
+                flow->dist[n] = flow->dist[cell] + 1;
+                flow->next[n] = cell;
+                queue[rear++] = n;
+            }
+        }
+    }
+    scratch_release(&game->scratch, mark);
+
+    for(int x = 0; x < GRID_WIDTH; x++) {
+        for(int y = 0; y < GRID_HEIGHT; y++) {
+            int cell = idx(x, y);
+            if(grid_tower(game, cell) == TOWER_NONE) continue;
+            for(int i = 0; i < 4; i++) {
+                int nx = x + dx[i];
+                int ny = y + dy[i];
+                if(nx < 0 || nx >= GRID_WIDTH || ny < 0 || ny >= GRID_HEIGHT) continue;
+                int n = idx(nx, ny);
+                if(grid_tower(game, n) != TOWER_NONE) continue;
+                if(flow->dist[n] == FLOW_UNREACHABLE) continue;
+                if(flow->dist[cell] == FLOW_UNREACHABLE || flow->dist[n] + 1 < flow->dist[cell]) {
+                    flow->dist[cell] = flow->dist[n] + 1;
+                    flow->next[cell] = n;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Rebuilds the flow field toward the exits if the grid changed since the last build.
+ * @param game Pointer to the current game state.
+ */
+void flow_field_update(GameState* game) {
+    if(game->flow.generation == game->grid_generation) return;
+    uint32_t start = profile_now();
+    flow_field_build(game);
+    profiler_record(&game->profiler, ProfilePath, start);
+}
+
+/**
+ * @brief Checks whether a cell is one of the map's exits.
+ * @param map The map layout.
+ * @param cell The 1D cell index.
+ * @return True if the cell is an exit.
+ */
+static bool map_is_exit(const MapLayout* map, int cell) {
+    for(int e = 0; e < map->exit_count; e++) {
+        if(idx(map->exits[e].x, map->exits[e].y) == cell) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Checks whether a cell is one of the map's spawns.
+ * @param map The map layout.
+ * @param cell The 1D cell index.
+ * @return True if the cell is a spawn.
+ */
+static bool map_is_spawn(const MapLayout* map, int cell) {
+    for(int s = 0; s < map->spawn_count; s++) {
+        if(idx(map->spawns[s].x, map->spawns[s].y) == cell) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Rebuilds the placement legality index from the current grid.
+ *
+ * Runs one iterative Tarjan DFS over the free cells, rooted at a virtual sink joined to every
+ * exit. A free cell blocks the path exactly when it is an articulation point whose cut-off
+ * subtree contains a spawn, since that spawn then reaches no exit. Every cell is classified in
+ * a single O(cells) pass instead of one BFS per candidate cell. Spawns and exits themselves
+ * are CELL_FLAG_RESERVED and refused by placement_blocks_path().
+ * @param game Pointer to the current game state.
+ */
+static void placement_index_build(GameState* game) {
+    PlacementIndex* placement = &game->placement;
+    placement->generation = game->grid_generation;
+    const MapLayout* map = game->map;
+    const int sink = GRID_CELLS;
+    memset(placement->blocking, 0, sizeof(placement->blocking));
+
+    // One extra node per array, at index GRID_CELLS, for the sink
+    size_t mark = game->scratch.used;
+    uint16_t* disc = scratch_alloc(&game->scratch, (GRID_CELLS + 1) * sizeof(uint16_t));
+    uint16_t* low = scratch_alloc(&game->scratch, (GRID_CELLS + 1) * sizeof(uint16_t));
+    uint16_t* stack = scratch_alloc(&game->scratch, (GRID_CELLS + 1) * sizeof(uint16_t));
+    uint8_t* dir = scratch_alloc(&game->scratch, GRID_CELLS + 1);
+    bool* has_spawn = scratch_alloc(&game->scratch, (GRID_CELLS + 1) * sizeof(bool));
+    memset(disc, 0, (GRID_CELLS + 1) * sizeof(uint16_t));
+
+    int dx[4] = {1, -1, 0, 0};
+    int dy[4] = {0, 0, 1, -1};
+    uint16_t time = 1;
+    int sp = 0;
+    disc[sink] = low[sink] = time++;
+    dir[sink] = 0;
+    has_spawn[sink] = false;
+    stack[sp++] = sink;
+    while(sp > 0) {
+        int v = stack[sp - 1];
+        // The sink's edges lead to the exits; a cell's edges are its four neighbours, plus the
+        // sink for an exit
+        int degree = v == sink ? map->exit_count : map_is_exit(map, v) ? 5 : 4;
+        if(dir[v] < degree) {
+            int d = dir[v]++;
+            int n;
+            if(v == sink) {
+                n = idx(map->exits[d].x, map->exits[d].y);
+            } else if(d == 4) {
+                n = sink;
+            } else {
+                Coord c = cell_coord(v);
+                int nx = c.x + dx[d];
+                int ny = c.y + dy[d];
+                if(nx < 0 || nx >= GRID_WIDTH || ny < 0 || ny >= GRID_HEIGHT) continue;
+                n = idx(nx, ny);
+            }
+            if(n != sink && grid_tower(game, n) != TOWER_NONE) continue;
+            if(disc[n] == 0) {
+                disc[n] = low[n] = time++;
+                dir[n] = 0;
+                has_spawn[n] = map_is_spawn(map, n);
+                stack[sp++] = n;
+            } else if(sp < 2 || n != stack[sp - 2]) {
+                if(disc[n] < low[v]) low[v] = disc[n];
+            }
+        } else {
+            sp--;
+            if(sp == 0) break;
+            int p = stack[sp - 1];
+            if(low[v] < low[p]) low[p] = low[v];
+            if(has_spawn[v]) {
+                has_spawn[p] = true;
+                if(p != sink && low[v] >= disc[p]) placement->blocking[p / 8] |= 1 << (p % 8);
+            }
+        }
+    }
+
+    // With a spawn already cut off, no placement can restore its path
+    for(int s = 0; s < map->spawn_count; s++) {
+        if(disc[idx(map->spawns[s].x, map->spawns[s].y)] == 0) {
+            memset(placement->blocking, 0xFF, sizeof(placement->blocking));
+        }
+    }
+    scratch_release(&game->scratch, mark);
+}
+
+/**
+ * @brief Rebuilds the placement legality index if the grid changed since the last build.
+ * @param game Pointer to the current game state.
+ */
+void placement_index_update(GameState* game) {
+    if(game->placement.generation == game->grid_generation) return;
+    uint32_t start = profile_now();
+    placement_index_build(game);
+    profiler_record(&game->profiler, ProfilePath, start);
+}
+
+/**
+ * @brief Checks whether placing a tower on a free cell would cut a spawn off from every exit.
+ * @param game Pointer to the current game state.
+ * @param x The x-coordinate on the grid.
+ * @param y The y-coordinate on the grid.
+ * @return True if the placement would block the path or the cell is reserved, false otherwise.
+ */
+bool placement_blocks_path(GameState* game, int x, int y) {
+    int cell = idx(x, y);
+    if(grid_packed(game, cell) & CELL_FLAG_RESERVED) return true;
+    placement_index_update(game);
+    return game->placement.blocking[cell / 8] & (1 << (cell % 8));
 }
 
 /**
@@ -127,92 +542,369 @@ bool find_path(GameState* game, Coord start, Coord end, Coord path[], int* path_
  */
 void spawn_wave(GameState* game) {
     Wave wave_params = get_wave_params(game->wave);
-    for(int i = 0; i < MAX_ENEMIES; i++) {
-        game->enemies[i].active = false;
-    }
+    slot_pool_init(&game->enemies.slots, MAX_ENEMIES);
     game->wave_spawn_index = 0;
     game->pre_wave_timer = PRE_WAVE_TICKS;
     game->wave_spawn_timer = wave_params.spawn_interval_ticks;
 }
 
 /**
- * @brief Checks if all enemies in the game are currently inactive.
+ * @brief Checks if no active enemy can still reach the exit.
+ *
+ * Towers placed mid-wave can wall an enemy into a pocket. It waits there and walks on once a
+ * path opens, but does not hold the wave open; the next wave clears it.
  * @param game Pointer to the current game state.
- * @return True if all enemies are inactive, false otherwise.
+ * @return True if every active enemy is cut off from the exit, or none is active.
  */
-bool all_enemies_inactive(GameState* game) {
-    for(int i = 0; i < MAX_ENEMIES; i++) {
-        if(game->enemies[i].active) return false;
+bool all_enemies_stranded(GameState* game) {
+    flow_field_update(game);
+    for(int i = slot_pool_next(&game->enemies.slots, -1); i >= 0;
+        i = slot_pool_next(&game->enemies.slots, i)) {
+        Coord pos = game->enemies.pos[i];
+        if(game->flow.dist[idx(pos.x, pos.y)] != FLOW_UNREACHABLE) return false;
     }
     return true;
 }
 
+/**
+ * @brief Compares how far two enemies are from the end of their path.
+ *
+ * Enemies on a cell cut off from every exit have FLOW_UNREACHABLE left and come last. Slots
+ * break exact ties, so the order is total and does not depend on the previous one.
+ * @param game Pointer to the current game state.
+ * @param a An enemy slot.
+ * @param b Another enemy slot.
+ * @return True if a is closer to an exit than b.
+ */
+static bool enemy_ahead(const GameState* game, int a, int b) {
+    const EnemyPool* enemies = &game->enemies;
+    uint16_t dist_a = game->flow.dist[idx(enemies->pos[a].x, enemies->pos[a].y)];
+    uint16_t dist_b = game->flow.dist[idx(enemies->pos[b].x, enemies->pos[b].y)];
+    if(dist_a != dist_b) return dist_a < dist_b;
+    if(enemies->progress[a] != enemies->progress[b]) {
+        return enemies->progress[a] > enemies->progress[b];
+    }
+    return a < b;
+}
+
+/**
+ * @brief Re-sorts the live enemies by path order and rebuilds the per-cell enemy buckets.
+ *
+ * Last tick's order is kept for the enemies still alive and new ones are appended, so the
+ * insertion sort only moves the few that overtook or spawned.
+ * @param game Pointer to the current game state.
+ */
+void enemy_index_rebuild(GameState* game) {
+    EnemyIndex* index = &game->enemy_index;
+    flow_field_update(game);
+
+    uint32_t listed[SLOT_MASK_WORDS] = {0};
+    int count = 0;
+    for(int r = 0; r < index->count; r++) {
+        int i = index->order[r];
+        if(!slot_pool_is_live(&game->enemies.slots, i)) continue;
+        index->order[count++] = i;
+        listed[i / 32] |= 1u << (i % 32);
+    }
+    for(int i = slot_pool_next(&game->enemies.slots, -1); i >= 0;
+        i = slot_pool_next(&game->enemies.slots, i)) {
+        if(!(listed[i / 32] & (1u << (i % 32)))) index->order[count++] = i;
+    }
+    index->count = count;
+    for(int r = 1; r < count; r++) {
+        int i = index->order[r];
+        int s = r;
+        for(; s > 0 && enemy_ahead(game, i, index->order[s - 1]); s--) {
+            index->order[s] = index->order[s - 1];
+        }
+        index->order[s] = i;
+    }
+
+    for(int cell = 0; cell < GRID_CELLS; cell++) {
+        index->head[cell] = -1;
+    }
+    memset(index->occupied, 0, sizeof(index->occupied));
+    // Push from last to first so every bucket ends up in path order
+    for(int r = count - 1; r >= 0; r--) {
+        int i = index->order[r];
+        int cell = idx(game->enemies.pos[i].x, game->enemies.pos[i].y);
+        index->rank[i] = r;
+        index->next[i] = index->head[cell];
+        index->head[cell] = i;
+        index->occupied[cell / 32] |= 1u << (cell % 32);
+    }
+}
+
+/**
+ * @brief Returns how far a tower reaches.
+ * @param tower The tower type.
+ * @return The Chebyshev radius in cells.
+ */
+static int tower_range(TowerType tower) {
+    switch(tower) {
+    case TOWER_NORMAL:
+        return 1;
+    case TOWER_RANGE:
+        return 2;
+    case TOWER_SPLASH:
+    case TOWER_FREEZE:
+    default:
+        return 1;
+    }
+}
+
+/**
+ * @brief Rebuilds the tower list and each tower's range if the grid changed.
+ *
+ * Towers are listed in the order update_tower_firing() used to scan the grid in, so they keep
+ * firing, and claiming projectile slots, in the same order.
+ * @param game Pointer to the current game state.
+ */
+void coverage_index_update(GameState* game) {
+    CoverageIndex* coverage = &game->coverage;
+    if(coverage->generation == game->grid_generation) return;
+    coverage->generation = game->grid_generation;
+
+    coverage->count = 0;
+    for(int cell = 0; cell < GRID_CELLS; cell++) {
+        TowerType tower = grid_tower(game, cell);
+        if(tower == TOWER_NONE) continue;
+        coverage->cell[coverage->count] = cell;
+        coverage->range[coverage->count] = tower_range(tower);
+        coverage->count++;
+    }
+}
+
+// Targeting policy of each tower type
+static const TargetPolicy tower_target_policies[] = {
+    [TOWER_NONE] = TargetFirst,
+    [TOWER_NORMAL] = TargetFirst,
+    [TOWER_RANGE] = TargetStrongest,
+    [TOWER_SPLASH] = TargetFirst,
+    [TOWER_FREEZE] = TargetStrongest,
+};
+
+/**
+ * @brief Checks whether a tower with the given policy prefers one enemy over another.
+ * @param game Pointer to the current game state.
+ * @param policy The tower's targeting policy.
+ * @param e The candidate enemy slot.
+ * @param best The enemy slot picked so far.
+ * @return True if e should replace best.
+ */
+static bool target_better(const GameState* game, TargetPolicy policy, int e, int best) {
+    const uint16_t* rank = game->enemy_index.rank;
+    const int* hp = game->enemies.hp;
+    switch(policy) {
+    case TargetLast:
+        return rank[e] > rank[best];
+    case TargetStrongest:
+        if(hp[e] != hp[best]) return hp[e] > hp[best];
+        break;
+    case TargetWeakest:
+        if(hp[e] != hp[best]) return hp[e] < hp[best];
+        break;
+    case TargetFirst:
+    default:
+        break;
+    }
+    return rank[e] < rank[best];
+}
+
+/**
+ * @brief Picks the enemy a tower fires at among those in the cells it covers.
+ *
+ * Each covered column is a run of at most 2 * range + 1 consecutive cell bits in
+ * EnemyIndex.occupied, read through one 64-bit window. Buckets are in path order, so the
+ * first policy only looks at the head of each occupied cell. The other policies are a linear
+ * scan over every enemy in range.
+ * @param game Pointer to the current game state.
+ * @param t The tower's position in the coverage index.
+ * @param policy How the tower chooses between enemies in range.
+ * @return The enemy slot, or -1 if no enemy is in range.
+ */
+static int coverage_select_target(const GameState* game, int t, TargetPolicy policy) {
+    const EnemyIndex* index = &game->enemy_index;
+    Coord c = cell_coord(game->coverage.cell[t]);
+    int range = game->coverage.range[t];
+    int x0 = c.x - range < 0 ? 0 : c.x - range;
+    int x1 = c.x + range >= GRID_WIDTH ? GRID_WIDTH - 1 : c.x + range;
+    int y0 = c.y - range < 0 ? 0 : c.y - range;
+    int y1 = c.y + range >= GRID_HEIGHT ? GRID_HEIGHT - 1 : c.y + range;
+    uint32_t run_mask = (1u << (y1 - y0 + 1)) - 1;
+    int best = -1;
+    for(int x = x0; x <= x1; x++) {
+        int first = idx(x, y0);
+        int word = first / 32;
+        uint64_t window = index->occupied[word] | (uint64_t)index->occupied[word + 1] << 32;
+        uint32_t bits = (uint32_t)(window >> (first % 32)) & run_mask;
+        while(bits) {
+            for(int e = index->head[first + __builtin_ctz(bits)]; e >= 0; e = index->next[e]) {
+                if(best < 0 || target_better(game, policy, e, best)) best = e;
+                if(policy == TargetFirst) break;
+            }
+            bits &= bits - 1;
+        }
+    }
+    return best;
+}
+
 /**
  * @brief Updates the position of all active enemies based on the current path.
+ *
+ * Also rebuilds the per-cell enemy index used by tower targeting and projectile hits.
  * @param game Pointer to the current game state.
  */
 void update_enemies(GameState* game) {
-    Coord global_path[GRID_WIDTH * GRID_HEIGHT];
-    int global_path_length = 0;
-    Coord start = {0, 0};
-    Coord end = {GRID_WIDTH - 1, GRID_HEIGHT - 1};
-    bool valid_path = find_path(game, start, end, global_path, &global_path_length);
+    flow_field_update(game);
+    const FlowField* flow = &game->flow;
 
     Wave wave_params = get_wave_params(game->wave);
-    for(int i = 0; i < MAX_ENEMIES; i++) {
-        if(game->enemies[i].active) {
-            if(game->enemies[i].freeze_timer > 0) {
-                game->enemies[i].freeze_timer--;
-            } else if(valid_path && game->enemies[i].path_index < global_path_length - 1) {
-                game->enemies[i].progress += wave_params.enemy_speed;
-                while(game->enemies[i].progress >= 1.0f &&
-                      game->enemies[i].path_index < global_path_length - 1) {
-                    game->enemies[i].progress -= 1.0f;
-                    game->enemies[i].path_index++;
-                    game->enemies[i].pos = global_path[game->enemies[i].path_index];
-                    if(game->enemies[i].path_index == global_path_length - 1) {
-                        game->lives--;
-                        game->enemies[i].active = false;
-                        break;
-                    }
+    for(int i = slot_pool_next(&game->enemies.slots, -1); i >= 0;
+        i = slot_pool_next(&game->enemies.slots, i)) {
+        int cell = idx(game->enemies.pos[i].x, game->enemies.pos[i].y);
+        if(game->enemies.freeze_timer[i] > 0) {
+            game->enemies.freeze_timer[i]--;
+        } else if(flow->dist[cell] != FLOW_UNREACHABLE) {
+            game->enemies.progress[i] += wave_params.enemy_speed;
+            while(game->enemies.progress[i] >= SCALAR_ONE) {
+                game->enemies.progress[i] -= SCALAR_ONE;
+                cell = flow->next[cell];
+                game->enemies.pos[i] = cell_coord(cell);
+                if(flow->dist[cell] == 0) {
+                    game->lives--;
+                    slot_pool_release(&game->enemies.slots, i);
+                    break;
                 }
             }
         }
     }
+    enemy_index_rebuild(game);
+}
+
+/**
+ * @brief Clamps a value to an inclusive range.
+ * @param value The value to clamp.
+ * @param lo The lowest allowed value.
+ * @param hi The highest allowed value.
+ * @return value limited to [lo, hi].
+ */
+static inline int clamp_int(int value, int lo, int hi) {
+    return value < lo ? lo : value > hi ? hi : value;
+}
+
+/**
+ * @brief Returns the impact wheel bucket holding the projectiles that land on a tick.
+ * @param projectiles The projectile pool.
+ * @param tick The tick of impact, less than PROJECTILE_MAX_FLIGHT_TICKS ticks from now.
+ * @return A SLOT_MASK_WORDS bitmask of projectile slots.
+ */
+static inline uint32_t* projectile_due_mask(ProjectilePool* projectiles, uint32_t tick) {
+    return projectiles->due[tick % PROJECTILE_MAX_FLIGHT_TICKS];
+}
+
+/**
+ * @brief Predicts when and where a projectile fired now would meet an enemy.
+ *
+ * Steps a copy of the enemy along the flow field the way update_enemies() will move it, until
+ * the projectile could reach the enemy's hit box, which is exactly its grid cell, by that tick.
+ * Freezes applied later and grid changes during the flight are not foreseen; the projectile
+ * homes on the enemy at impact, so those only shift where the flight appears to end. An enemy
+ * walled off from the exit stays on its cell, so it is caught once in reach.
+ * @param game Pointer to the current game state.
+ * @param from_x The x pixel the projectile starts from.
+ * @param from_y The y pixel the projectile starts from.
+ * @param target The enemy slot.
+ * @param aim Receives the pixel on the enemy's hit box closest to the start point.
+ * @return Ticks from now until impact, or -1 if the enemy escapes or outruns the projectile.
+ */
+static int projectile_intercept(
+    const GameState* game,
+    int from_x,
+    int from_y,
+    int target,
+    Coord* aim) {
+    const FlowField* flow = &game->flow;
+    Scalar speed = get_wave_params(game->wave).enemy_speed;
+    int cell = idx(game->enemies.pos[target].x, game->enemies.pos[target].y);
+    Scalar progress = game->enemies.progress[target];
+    int freeze = game->enemies.freeze_timer[target];
+    for(int ticks = 0; ticks < PROJECTILE_MAX_FLIGHT_TICKS; ticks++) {
+        Coord c = cell_coord(cell);
+        int left = c.x * CELL_SIZE;
+        int top = STATUS_BAR_HEIGHT + c.y * CELL_SIZE;
+        int hit_x = clamp_int(from_x, left, left + CELL_SIZE - 1);
+        int hit_y = clamp_int(from_y, top, top + CELL_SIZE - 1);
+        int dx = hit_x - from_x;
+        int dy = hit_y - from_y;
+        // The projectile moves once in the tick it is fired and once per tick after that
+        int reach = PROJECTILE_SPEED * (ticks + 1);
+        if(dx * dx + dy * dy <= reach * reach) {
+            *aim = (Coord){hit_x, hit_y};
+            return ticks;
+        }
+        if(freeze > 0) {
+            freeze--;
+        } else if(flow->dist[cell] != FLOW_UNREACHABLE) {
+            progress += speed;
+            while(progress >= SCALAR_ONE) {
+                progress -= SCALAR_ONE;
+                cell = flow->next[cell];
+                if(flow->dist[cell] == 0) return -1;
+            }
+        }
+    }
+    return -1;
 }
 
 /**
- * @brief Spawns a new projectile from a tower towards a target.
+ * @brief Fires a projectile from a tower at an enemy, if it can catch the enemy in flight.
+ *
+ * The impact tick and a straight flight line ending on the enemy's predicted cell are fixed
+ * here, and the slot is queued in the impact wheel; nothing is updated per tick afterwards.
  * @param game Pointer to the current game state.
  * @param tx The tower's x grid coordinate.
  * @param ty The tower's y grid coordinate.
  * @param type The type of the tower firing.
- * @param target The coordinate of the target enemy.
+ * @param target The enemy slot to fire at.
  */
-void spawn_projectile(GameState* game, int tx, int ty, TowerType type, Coord target) {
+void spawn_projectile(GameState* game, int tx, int ty, TowerType type, int target) {
+    ProjectilePool* projectiles = &game->projectiles;
     int grid_top = STATUS_BAR_HEIGHT;
-    float tower_cx = tx * CELL_SIZE + CELL_SIZE / 2.0f;
-    float tower_cy = grid_top + ty * CELL_SIZE + CELL_SIZE / 2.0f;
-    float enemy_cx = target.x * CELL_SIZE + CELL_SIZE / 2.0f;
-    float enemy_cy = grid_top + target.y * CELL_SIZE + CELL_SIZE / 2.0f;
-    float dx = enemy_cx - tower_cx;
-    float dy = enemy_cy - tower_cy;
-    float dist = sqrtf(dx * dx + dy * dy);
-    if(dist == 0) dist = 1;
-    float vx = PROJECTILE_SPEED * dx / dist;
-    float vy = PROJECTILE_SPEED * dy / dist;
-    for(int p = 0; p < MAX_PROJECTILES; p++) {
-        if(!game->projectiles[p].active) {
-            game->projectiles[p].active = true;
-            game->projectiles[p].x = tower_cx;
-            game->projectiles[p].y = tower_cy;
-            game->projectiles[p].vx = vx;
-            game->projectiles[p].vy = vy;
-            game->projectiles[p].damage = 1;
-            game->projectiles[p].tower_type = type;
-            break;
+    int tower_cx = tx * CELL_SIZE + CELL_SIZE / 2;
+    int tower_cy = grid_top + ty * CELL_SIZE + CELL_SIZE / 2;
+    Coord aim;
+    int flight_ticks = projectile_intercept(game, tower_cx, tower_cy, target, &aim);
+    if(flight_ticks < 0) return;
+
+    int p = slot_pool_acquire(&projectiles->slots);
+    if(p < 0) {
+        game->projectiles_dropped++;
+        if(PROJECTILE_POOL_FULL_POLICY != PoolFullEvictOldest) return;
+        // Full pools are rare, so a scan for the oldest shot is acceptable here
+        p = slot_pool_next(&projectiles->slots, -1);
+        for(int q = slot_pool_next(&projectiles->slots, p); q >= 0;
+            q = slot_pool_next(&projectiles->slots, q)) {
+            if(projectiles->spawn_tick[q] < projectiles->spawn_tick[p]) p = q;
         }
+        projectile_due_mask(projectiles, projectiles->impact_tick[p])[p / 32] &= ~(1u << (p % 32));
     }
+
+    // Cover the distance in exactly flight_ticks + 1 moves so the flight ends on the hit box
+    Scalar moves = SCALAR_FROM_INT(flight_ticks + 1);
+    int dx = aim.x - tower_cx;
+    int dy = aim.y - tower_cy;
+    projectiles->x[p] = SCALAR_FROM_INT(tower_cx);
+    projectiles->y[p] = SCALAR_FROM_INT(tower_cy);
+    projectiles->vx[p] = SCALAR_DIV(SCALAR_FROM_INT(dx), moves);
+    projectiles->vy[p] = SCALAR_DIV(SCALAR_FROM_INT(dy), moves);
+    projectiles->spawn_tick[p] = game->tick;
+    projectiles->impact_tick[p] = game->tick + flight_ticks;
+    projectiles->target[p] = target;
+    projectiles->target_serial[p] = game->enemies.serial[target];
+    projectiles->damage[p] = 1;
+    projectiles->tower_type[p] = type;
+    projectile_due_mask(projectiles, projectiles->impact_tick[p])[p / 32] |= 1u << (p % 32);
 }
 
 /**
@@ -220,33 +912,46 @@ void spawn_projectile(GameState* game, int tx, int ty, TowerType type, Coord tar
  * @param game Pointer to the current game state.
  */
 void update_tower_firing(GameState* game) {
-    for(int tx = 0; tx < GRID_WIDTH; tx++) {
-        for(int ty = 0; ty < GRID_HEIGHT; ty++) {
-            TowerType tower = game->grid[tx][ty];
-            if(tower != TOWER_NONE) {
-                int tower_range;
-                switch(tower) {
-                case TOWER_NORMAL:
-                    tower_range = 1;
-                    break;
-                case TOWER_RANGE:
-                    tower_range = 2;
-                    break;
-                case TOWER_SPLASH:
-                case TOWER_FREEZE:
-                default:
-                    tower_range = 1;
-                    break;
-                }
-                for(int i = 0; i < MAX_ENEMIES; i++) {
-                    if(game->enemies[i].active) {
-                        int dx = abs(game->enemies[i].pos.x - tx);
-                        int dy = abs(game->enemies[i].pos.y - ty);
-                        if(dx <= tower_range && dy <= tower_range) {
-                            spawn_projectile(game, tx, ty, tower, game->enemies[i].pos);
-                            break;
-                        }
-                    }
+    coverage_index_update(game);
+    if(game->enemies.slots.live_count == 0) return;
+    const CoverageIndex* coverage = &game->coverage;
+    for(int t = 0; t < coverage->count; t++) {
+        TowerType tower = grid_tower(game, coverage->cell[t]);
+        int target = coverage_select_target(game, t, tower_target_policies[tower]);
+        if(target >= 0) {
+            Coord c = cell_coord(coverage->cell[t]);
+            spawn_projectile(game, c.x, c.y, tower, target);
+        }
+    }
+}
+
+/**
+ * @brief Applies a landed projectile's damage and effects to its target.
+ *
+ * A target that died, reached the exit or whose slot was reused in the meantime is missed.
+ * @param game Pointer to the current game state.
+ * @param p The projectile slot.
+ */
+static void projectile_impact(GameState* game, int p) {
+    const ProjectilePool* projectiles = &game->projectiles;
+    int i = projectiles->target[p];
+    if(!slot_pool_is_live(&game->enemies.slots, i) ||
+       game->enemies.serial[i] != projectiles->target_serial[p]) {
+        return;
+    }
+    game->enemies.hp[i] -= projectiles->damage[p];
+    if(projectiles->tower_type[p] == TOWER_FREEZE) game->enemies.freeze_timer[i] = 3;
+    if(projectiles->tower_type[p] == TOWER_SPLASH) {
+        Coord hit = game->enemies.pos[i];
+        int x0 = hit.x > 0 ? hit.x - 1 : 0;
+        int x1 = hit.x < GRID_WIDTH - 1 ? hit.x + 1 : GRID_WIDTH - 1;
+        int y0 = hit.y > 0 ? hit.y - 1 : 0;
+        int y1 = hit.y < GRID_HEIGHT - 1 ? hit.y + 1 : GRID_HEIGHT - 1;
+        for(int x = x0; x <= x1; x++) {
+            for(int y = y0; y <= y1; y++) {
+                for(int j = game->enemy_index.head[idx(x, y)]; j >= 0;
+                    j = game->enemy_index.next[j]) {
+                    game->enemies.hp[j] -= projectiles->damage[p];
                 }
             }
         }
@@ -254,122 +959,348 @@ void update_tower_firing(GameState* game) {
 }
 
 /**
- * @brief Updates projectile positions and handles collisions with enemies.
+ * @brief Resolves the projectiles that land this tick and removes defeated enemies.
+ *
+ * Only the impact wheel bucket for the current tick is visited, so projectiles in flight cost
+ * nothing here.
  * @param game Pointer to the current game state.
  */
 void update_projectiles(GameState* game) {
-    int grid_top = STATUS_BAR_HEIGHT;
-    for(int p = 0; p < MAX_PROJECTILES; p++) {
-        if(game->projectiles[p].active) {
-            game->projectiles[p].x += game->projectiles[p].vx;
-            game->projectiles[p].y += game->projectiles[p].vy;
-            if(game->projectiles[p].x < 0 || game->projectiles[p].x >= SCREEN_WIDTH ||
-               game->projectiles[p].y < grid_top || game->projectiles[p].y >= SCREEN_HEIGHT) {
-                game->projectiles[p].active = false;
-                continue;
-            }
-            for(int i = 0; i < MAX_ENEMIES; i++) {
-                if(game->enemies[i].active) {
-                    int enemy_left = game->enemies[i].pos.x * CELL_SIZE;
-                    int enemy_top = grid_top + game->enemies[i].pos.y * CELL_SIZE;
-                    int enemy_right = enemy_left + CELL_SIZE;
-                    int enemy_bottom = enemy_top + CELL_SIZE;
-                    if(game->projectiles[p].x >= enemy_left &&
-                       game->projectiles[p].x < enemy_right &&
-                       game->projectiles[p].y >= enemy_top &&
-                       game->projectiles[p].y < enemy_bottom) {
-                        game->enemies[i].hp -= game->projectiles[p].damage;
-                        if(game->projectiles[p].tower_type == TOWER_FREEZE)
-                            game->enemies[i].freeze_timer = 3;
-                        if(game->projectiles[p].tower_type == TOWER_SPLASH) {
-                            for(int j = 0; j < MAX_ENEMIES; j++) {
-                                if(game->enemies[j].active) {
-                                    int ddx = abs(game->enemies[j].pos.x - game->enemies[i].pos.x);
-                                    int ddy = abs(game->enemies[j].pos.y - game->enemies[i].pos.y);
-                                    if(ddx <= 1 && ddy <= 1)
-                                        game->enemies[j].hp -= game->projectiles[p].damage;
-                                }
-                            }
-                        }
-                        game->projectiles[p].active = false;
-                        break;
-                    }
-                }
-            }
+    ProjectilePool* projectiles = &game->projectiles;
+    uint32_t* due = projectile_due_mask(projectiles, game->tick);
+    for(int word = 0; word < SLOT_MASK_WORDS; word++) {
+        uint32_t bits = due[word];
+        due[word] = 0;
+        while(bits) {
+            int p = word * 32 + __builtin_ctz(bits);
+            bits &= bits - 1;
+            projectile_impact(game, p);
+            slot_pool_release(&projectiles->slots, p);
         }
     }
-    for(int i = 0; i < MAX_ENEMIES; i++) {
-        if(game->enemies[i].active && game->enemies[i].hp <= 0) {
-            game->enemies[i].active = false;
+    for(int i = slot_pool_next(&game->enemies.slots, -1); i >= 0;
+        i = slot_pool_next(&game->enemies.slots, i)) {
+        if(game->enemies.hp[i] <= 0) {
+            slot_pool_release(&game->enemies.slots, i);
             game->gold += 5;
         }
     }
 }
 
+// Sprites in sprite_atlas. Towers sit at their TowerType, so a cell's type is its sprite.
+typedef enum {
+    SpriteBlocked = TOWER_NONE, // Placement shading on a cell where a tower would block the path
+    SpriteEnemy = TOWER_FREEZE + 1,
+    SpriteCount,
+} SpriteId;
+
+// 8x8 sprites for cell-aligned blits into the 1-bit layers, one byte per row with the LSB as
+// the leftmost pixel. Row 0 and bit 0 stay clear, where the cell's grid lines run.
+static const uint8_t sprite_atlas[SpriteCount][CELL_SIZE] = {
+    [SpriteBlocked] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00},
+    [TOWER_NORMAL] = {0x00, 0x44, 0x44, 0x4C, 0x54, 0x64, 0x44, 0x44}, // N
+    [TOWER_RANGE] = {0x00, 0x3C, 0x44, 0x44, 0x3C, 0x14, 0x24, 0x44}, // R
+    [TOWER_SPLASH] = {0x00, 0x78, 0x04, 0x04, 0x38, 0x40, 0x40, 0x3C}, // S
+    [TOWER_FREEZE] = {0x00, 0x7C, 0x04, 0x04, 0x3C, 0x04, 0x04, 0x04}, // F
+    // The pixels canvas_draw_circle() sets for a radius 3 circle centred in the cell
+    [SpriteEnemy] = {0x00, 0x38, 0x44, 0x82, 0x82, 0x82, 0x44, 0x38},
+};
+
+_Static_assert(CELL_SIZE == 8, "sprites and cells are one byte wide");
+
 /**
- * @brief Renders the entire game state to the canvas.
- * @param canvas The canvas to draw on.
+ * @brief ORs a sprite into a view-sized 1-bit layer. Cells are byte aligned, so this is one
+ * byte per row and costs the same wherever the cell is.
+ * @param bitmap A BACKGROUND_WIDTH x BACKGROUND_HEIGHT XBM.
+ * @param cx The view column of the cell.
+ * @param cy The view row of the cell.
+ * @param sprite The sprite to draw.
+ */
+static inline void sprite_blit(uint8_t* bitmap, int cx, int cy, SpriteId sprite) {
+    uint8_t* cell = &bitmap[cy * CELL_SIZE * BACKGROUND_STRIDE + cx];
+    for(int row = 0; row < CELL_SIZE; row++) {
+        cell[row * BACKGROUND_STRIDE] |= sprite_atlas[sprite][row];
+    }
+}
+
+/**
+ * @brief Marks a render cache stale so the next frame redraws both layers.
+ * @param cache The cache to reset.
+ */
+void render_cache_reset(RenderCache* cache) {
+    cache->generation = 0;
+    cache->status_wave = -1;
+}
+
+/**
+ * @brief Redraws the cached background layer and status text if their inputs changed.
+ *
+ * The background covers the viewport only and is redrawn when the grid changes or the view
+ * scrolls. Towers and placement shading are blitted from sprite_atlas.
+ * @param cache The cache to bring up to date.
+ * @param snapshot The frame being drawn.
+ */
+static void render_cache_update(RenderCache* cache, const RenderSnapshot* snapshot) {
+    if(cache->status_lives != snapshot->lives || cache->status_gold != snapshot->gold ||
+       cache->status_wave != snapshot->wave) {
+        cache->status_lives = snapshot->lives;
+        cache->status_gold = snapshot->gold;
+        cache->status_wave = snapshot->wave;
+        snprintf(
+            cache->status,
+            sizeof(cache->status),
+            "Lives:%d Gold:%d Wave:%d",
+            snapshot->lives,
+            snapshot->gold,
+            snapshot->wave);
+    }
+
+    if(cache->generation == snapshot->grid_generation && cache->view.x == snapshot->view.x &&
+       cache->view.y == snapshot->view.y) {
+        return;
+    }
+    cache->generation = snapshot->grid_generation;
+    cache->view = snapshot->view;
+
+    uint8_t* bitmap = cache->background;
+    memset(bitmap, 0, sizeof(cache->background));
+    for(int y = 0; y < BACKGROUND_HEIGHT; y++) {
+        uint8_t* row = &bitmap[y * BACKGROUND_STRIDE];
+        if(y % CELL_SIZE == 0) {
+            memset(row, 0xFF, BACKGROUND_STRIDE);
+        } else {
+            for(int cx = 0; cx < VIEW_WIDTH; cx++) {
+                row[cx] = 0x01;
+            }
+        }
+    }
+
+    for(int cx = 0; cx < VIEW_WIDTH; cx++) {
+        for(int cy = 0; cy < VIEW_HEIGHT; cy++) {
+            uint8_t packed = snapshot->cells[cy * VIEW_WIDTH + cx];
+            TowerType tower = packed & CELL_TYPE_MASK;
+            if(tower != TOWER_NONE) {
+                sprite_blit(bitmap, cx, cy, (SpriteId)tower);
+            } else if(packed & RENDER_CELL_BLOCKING) {
+                sprite_blit(bitmap, cx, cy, SpriteBlocked);
+            }
+        }
+    }
+}
+
+#ifdef FLIPPER_TD_VECTOR_KERNELS
+/**
+ * @brief Floors each lane of a Scalar vector to a pixel, lane for lane what SCALAR_TO_INT does.
+ * @param s The positions to floor.
+ * @return The whole pixels.
+ */
+static inline IntVec scalar_vec_to_int(ScalarVec s) {
+#ifdef FLIPPER_TD_FIXED_POINT
+    return s >> SCALAR_FRAC_BITS;
+#else
+    IntVec truncated = __builtin_convertvector(s, IntVec);
+    // True lanes are -1, which steps a truncated negative position down to its floor
+    return truncated + (s < __builtin_convertvector(truncated, ScalarVec));
+#endif
+}
+#endif
+
+/**
+ * @brief Lists the screen pixel of every live projectile that is on screen, one slot at a
+ * time, in slot order. This is all the Flipper runs.
+ *
+ * A projectile's pixel after n moves is (x, y) + n * (vx, vy), floored.
  * @param game Pointer to the current game state.
+ * @param first The first slot to look at, 0 for the whole pool.
+ * @param dots Receives up to MAX_PROJECTILES screen pixels.
+ * @return The number of pixels written.
  */
-void draw_game(Canvas* canvas, GameState* game) {
-    canvas_reset(canvas);
-    char status[32];
-    snprintf(
-        status, sizeof(status), "Lives:%d Gold:%d Wave:%d", game->lives, game->gold, game->wave);
-    canvas_draw_str(canvas, 0, 7, status);
+int projectile_dots_scalar(const GameState* game, int first, Coord* dots) {
+    const ProjectilePool* projectiles = &game->projectiles;
+    int grid_top = STATUS_BAR_HEIGHT;
+    int view_x = game->view.x * CELL_SIZE;
+    int view_y = game->view.y * CELL_SIZE;
+    int count = 0;
+    for(int p = slot_pool_next(&projectiles->slots, first - 1); p >= 0;
+        p = slot_pool_next(&projectiles->slots, p)) {
+        Scalar moves = SCALAR_FROM_INT(game->tick - projectiles->spawn_tick[p] + 1);
+        Scalar x = projectiles->x[p] + SCALAR_MUL(projectiles->vx[p], moves);
+        Scalar y = projectiles->y[p] + SCALAR_MUL(projectiles->vy[p], moves);
+        int dot_x = SCALAR_TO_INT(x) - view_x;
+        int dot_y = SCALAR_TO_INT(y) - view_y;
+        if(dot_x < 0 || dot_x >= SCREEN_WIDTH || dot_y < grid_top || dot_y >= SCREEN_HEIGHT) {
+            continue;
+        }
+        dots[count++] = (Coord){dot_x, dot_y};
+    }
+    return count;
+}
 
+/**
+ * @brief Lists the screen pixel of every live projectile that is on screen, in slot order.
+ *
+ * With FLIPPER_TD_VECTOR_KERNELS the pool is evaluated and culled VECTOR_LANES slots at a
+ * time, live or not, and only live lanes are kept. Each lane does the same operations as
+ * projectile_dots_scalar(), which still handles the tail of the pool, so both give identical
+ * pixels; flipper_td_check compares them.
+ * @param game Pointer to the current game state.
+ * @param dots Receives up to MAX_PROJECTILES screen pixels.
+ * @return The number of pixels written.
+ */
+int projectile_dots(const GameState* game, Coord* dots) {
+    int count = 0;
+    int p = 0;
+#ifdef FLIPPER_TD_VECTOR_KERNELS
+    const ProjectilePool* projectiles = &game->projectiles;
     int grid_top = STATUS_BAR_HEIGHT;
-    for(int x = 0; x <= SCREEN_WIDTH; x += CELL_SIZE)
-        canvas_draw_line(canvas, x, grid_top, x, SCREEN_HEIGHT);
-    for(int y = grid_top; y <= SCREEN_HEIGHT; y += CELL_SIZE)
-        canvas_draw_line(canvas, 0, y, SCREEN_WIDTH, y);
-
-    for(int cx = 0; cx < GRID_WIDTH; cx++) {
-        for(int cy = 0; cy < GRID_HEIGHT; cy++) {
-            if(game->grid[cx][cy] != TOWER_NONE) {
-                int pos_x = cx * CELL_SIZE;
-                int pos_y = grid_top + cy * CELL_SIZE;
-                const char* label = "?";
-                switch(game->grid[cx][cy]) {
-                case TOWER_NORMAL:
-                    label = "N";
-                    break;
-                case TOWER_RANGE:
-                    label = "R";
-                    break;
-                case TOWER_SPLASH:
-                    label = "S";
-                    break;
-                case TOWER_FREEZE:
-                    label = "F";
-                    break;
-                default:
-                    break;
-                }
-                canvas_draw_str(canvas, pos_x + 2, pos_y + 7, label);
+    int view_x = game->view.x * CELL_SIZE;
+    int view_y = game->view.y * CELL_SIZE;
+    const IntVec lane_bits = {1, 2, 4, 8}; // Bit of each lane in a VECTOR_LANES live mask
+    for(; p + VECTOR_LANES <= MAX_PROJECTILES; p += VECTOR_LANES) {
+        uint32_t lanes = projectiles->slots.live[p / 32] >> (p % 32) & ((1u << VECTOR_LANES) - 1);
+        if(!lanes) continue;
+        ScalarVec x, y, vx, vy;
+        IntVec spawn_tick;
+        memcpy(&x, &projectiles->x[p], sizeof(x));
+        memcpy(&y, &projectiles->y[p], sizeof(y));
+        memcpy(&vx, &projectiles->vx[p], sizeof(vx));
+        memcpy(&vy, &projectiles->vy[p], sizeof(vy));
+        memcpy(&spawn_tick, &projectiles->spawn_tick[p], sizeof(spawn_tick));
+        // A dead lane's flight may be long over, so it is held at its start rather than moved
+        // far enough to overflow
+        IntVec live = ((int32_t)lanes & lane_bits) != 0;
+        IntVec lane_moves = ((int32_t)(game->tick + 1) - spawn_tick) & live;
+        // Same as SCALAR_MUL(v, SCALAR_FROM_INT(moves)), which is exact in fixed point
+#ifdef FLIPPER_TD_FIXED_POINT
+        IntVec moves = lane_moves;
+#else
+        ScalarVec moves = __builtin_convertvector(lane_moves, ScalarVec);
+#endif
+        IntVec dot_x = scalar_vec_to_int(x + vx * moves) - view_x;
+        IntVec dot_y = scalar_vec_to_int(y + vy * moves) - view_y;
+        IntVec visible = (dot_x >= 0) & (dot_x < SCREEN_WIDTH) & (dot_y >= grid_top) &
+                         (dot_y < SCREEN_HEIGHT);
+        for(int lane = 0; lane < VECTOR_LANES; lane++) {
+            if((lanes >> lane & 1) && visible[lane]) {
+                dots[count++] = (Coord){dot_x[lane], dot_y[lane]};
             }
         }
     }
+#endif
+    return count + projectile_dots_scalar(game, p, dots + count);
+}
 
-    for(int i = 0; i < MAX_ENEMIES; i++) {
-        if(game->enemies[i].active) {
-            int pos_x = game->enemies[i].pos.x * CELL_SIZE;
-            int pos_y = grid_top + game->enemies[i].pos.y * CELL_SIZE;
-            int center_x = pos_x + CELL_SIZE / 2;
-            int center_y = pos_y + CELL_SIZE / 2;
-            canvas_draw_circle(canvas, center_x, center_y, 3);
+/**
+ * @brief Copies what the next frame shows out of the game state.
+ *
+ * Runs on the simulation thread. Visible cells are only re-read when the grid or the view
+ * changed since this snapshot was last filled; enemies, projectiles and the cursor are
+ * shifted by the viewport and culled here, so drawing needs no game state at all.
+ * @param game Pointer to the current game state.
+ * @param snapshot The snapshot to fill.
+ */
+void render_snapshot_capture(GameState* game, RenderSnapshot* snapshot) {
+    if(snapshot->grid_generation != game->grid_generation || snapshot->view.x != game->view.x ||
+       snapshot->view.y != game->view.y) {
+        snapshot->grid_generation = game->grid_generation;
+        snapshot->view = game->view;
+        for(int cy = 0; cy < VIEW_HEIGHT; cy++) {
+            for(int cx = 0; cx < VIEW_WIDTH; cx++) {
+                int map_x = game->view.x + cx;
+                int map_y = game->view.y + cy;
+                uint8_t tower = grid_tower(game, idx(map_x, map_y));
+                if(tower == TOWER_NONE && placement_blocks_path(game, map_x, map_y)) {
+                    tower |= RENDER_CELL_BLOCKING;
+                }
+                snapshot->cells[cy * VIEW_WIDTH + cx] = tower;
+            }
         }
     }
 
-    for(int p = 0; p < MAX_PROJECTILES; p++) {
-        if(game->projectiles[p].active) {
-            canvas_draw_dot(canvas, (int)game->projectiles[p].x, (int)game->projectiles[p].y);
+    snapshot->lives = game->lives;
+    snapshot->gold = game->gold;
+    snapshot->wave = game->wave;
+    snapshot->overlay = game->profiler.overlay;
+    if(snapshot->overlay) {
+        memcpy(
+            snapshot->overlay_text, game->profiler.overlay_text, sizeof(snapshot->overlay_text));
+    }
+    snapshot->turbo_ticks_per_frame = 0;
+
+    int grid_top = STATUS_BAR_HEIGHT;
+    snapshot->cursor.x = (game->cursor.x - game->view.x) * CELL_SIZE;
+    snapshot->cursor.y = grid_top + (game->cursor.y - game->view.y) * CELL_SIZE;
+
+    int count = 0;
+    for(int i = slot_pool_next(&game->enemies.slots, -1); i >= 0;
+        i = slot_pool_next(&game->enemies.slots, i)) {
+        Coord pos = game->enemies.pos[i];
+        if(pos.x < game->view.x || pos.x >= game->view.x + VIEW_WIDTH ||
+           pos.y < game->view.y || pos.y >= game->view.y + VIEW_HEIGHT) {
+            continue;
         }
+        snapshot->enemies[count++] = (Coord){pos.x - game->view.x, pos.y - game->view.y};
+    }
+    snapshot->enemy_count = count;
+
+    snapshot->projectile_count = projectile_dots(game, snapshot->projectiles);
+}
+
+/**
+ * @brief Draws one captured frame to the canvas.
+ *
+ * Safe on the GUI thread while the game keeps running, since it reads only the snapshot and
+ * the caller's cache. Enemies are blitted into a copy of the cached background, so the grid,
+ * towers, enemies and status text take two draw calls however many there are; only
+ * projectiles and the cursor are drawn per entity.
+ * @param canvas The canvas to draw on.
+ * @param snapshot The frame to draw.
+ * @param cache The caller's pre-rendered layers, updated from the snapshot as needed.
+ */
+void render_snapshot_draw(Canvas* canvas, const RenderSnapshot* snapshot, RenderCache* cache) {
+    canvas_reset(canvas);
+    render_cache_update(cache, snapshot);
+    canvas_draw_str(canvas, 0, 7, snapshot->overlay ? snapshot->overlay_text : cache->status);
+
+    memcpy(cache->frame, cache->background, sizeof(cache->frame));
+    for(int i = 0; i < snapshot->enemy_count; i++) {
+        sprite_blit(cache->frame, snapshot->enemies[i].x, snapshot->enemies[i].y, SpriteEnemy);
     }
+    canvas_draw_xbm(
+        canvas, 0, STATUS_BAR_HEIGHT, BACKGROUND_WIDTH, BACKGROUND_HEIGHT, cache->frame);
+
+    for(int p = 0; p < snapshot->projectile_count; p++) {
+        canvas_draw_dot(canvas, snapshot->projectiles[p].x, snapshot->projectiles[p].y);
+    }
+    canvas_draw_box(canvas, snapshot->cursor.x, snapshot->cursor.y, CELL_SIZE, CELL_SIZE);
+}
 
-    int cur_x = game->cursor.x * CELL_SIZE;
-    int cur_y = grid_top + game->cursor.y * CELL_SIZE;
-    canvas_draw_box(canvas, cur_x, cur_y, CELL_SIZE, CELL_SIZE);
+/**
+ * @brief Prepares a draw context for a new or newly loaded game, so nothing cached from an
+ * earlier game is drawn.
+ * @param draw The draw context to reset.
+ */
+void draw_context_init(DrawContext* draw) {
+    draw->snapshot.grid_generation = 0;
+    render_cache_reset(&draw->cache);
+}
+
+/**
+ * @brief Renders the entire game state to the canvas on the calling thread.
+ *
+ * Captures into the context's snapshot and draws it with the context's cache, timing both
+ * halves. The host driver, the benchmark and replay playback draw this way.
+ * @param canvas The canvas to draw on.
+ * @param game Pointer to the current game state.
+ * @param draw The caller's draw context, set up with draw_context_init() for this game.
+ */
+void draw_game(Canvas* canvas, GameState* game, DrawContext* draw) {
+    uint32_t profile_start = profile_now();
+    render_snapshot_capture(game, &draw->snapshot);
+    profiler_record(&game->profiler, ProfileSnapshot, profile_start);
+    profile_start = profile_now();
+    render_snapshot_draw(canvas, &draw->snapshot, &draw->cache);
+    profiler_record(&game->profiler, ProfileDraw, profile_start);
 }
 
 /**
@@ -380,182 +1311,489 @@ void init_game_state(GameState* game) {
     game->lives = 10;
     game->gold = 100;
     game->wave = 1;
-    for(int x = 0; x < GRID_WIDTH; x++) {
-        for(int y = 0; y < GRID_HEIGHT; y++) {
-            game->grid[x][y] = TOWER_NONE;
-        }
+    memset(game->grid, 0, sizeof(game->grid));
+    game->map = &map_layouts[MAP_LAYOUT];
+    for(int s = 0; s < game->map->spawn_count; s++) {
+        Coord spawn = game->map->spawns[s];
+        grid_set_packed(game, idx(spawn.x, spawn.y), TOWER_NONE | CELL_FLAG_RESERVED);
     }
-    game->grid[2][2] = TOWER_NORMAL;
-    game->grid[4][2] = TOWER_RANGE;
-    game->grid[6][2] = TOWER_SPLASH;
-    game->grid[8][2] = TOWER_FREEZE;
+    for(int e = 0; e < game->map->exit_count; e++) {
+        Coord exit = game->map->exits[e];
+        grid_set_packed(game, idx(exit.x, exit.y), TOWER_NONE | CELL_FLAG_RESERVED);
+    }
+    set_grid_cell(game, 2, 2, TOWER_NORMAL);
+    set_grid_cell(game, 4, 2, TOWER_RANGE);
+    set_grid_cell(game, 6, 2, TOWER_SPLASH);
+    set_grid_cell(game, 8, 2, TOWER_FREEZE);
+    game->grid_generation = 1;
+    game->flow.generation = 0;
+    game->placement.generation = 0;
+    game->coverage.generation = 0;
+    scratch_reset(&game->scratch);
 
     game->cursor = (Coord){0, 0};
-    for(int i = 0; i < MAX_ENEMIES; i++) {
-        game->enemies[i].active = false;
-    }
-    for(int i = 0; i < MAX_PROJECTILES; i++) {
-        game->projectiles[i].active = false;
-    }
+    game->view = (Coord){0, 0};
+    slot_pool_init(&game->enemies.slots, MAX_ENEMIES);
+    slot_pool_init(&game->projectiles.slots, MAX_PROJECTILES);
+    memset(game->projectiles.due, 0, sizeof(game->projectiles.due));
+    // Batched kernels read dead slots too, so none start out uninitialized
+    memset(game->projectiles.x, 0, sizeof(game->projectiles.x));
+    memset(game->projectiles.y, 0, sizeof(game->projectiles.y));
+    memset(game->projectiles.vx, 0, sizeof(game->projectiles.vx));
+    memset(game->projectiles.vy, 0, sizeof(game->projectiles.vy));
+    memset(game->projectiles.spawn_tick, 0, sizeof(game->projectiles.spawn_tick));
+    memset(game->enemies.serial, 0, sizeof(game->enemies.serial));
+    game->projectiles_dropped = 0;
+    game->tick = 0;
+    profiler_reset(&game->profiler);
+    game->enemy_index.count = 0;
+    enemy_index_rebuild(game);
     spawn_wave(game);
 }
 
-// A struct to hold the game state and mutex together for callbacks
-typedef struct {
-    FuriMutex* mutex;
-    GameState* game;
-} GameContext;
-
 /**
- * @brief The render callback function passed to the GUI.
- * @param canvas The canvas to draw on.
- * @param ctx A void pointer to the GameContext.
+ * @brief Describes the build configuration that affects simulation results, so replays and
+ * snapshots from an incompatible build are rejected.
+ * @return A mask of BUILD_FLAG_* bits.
  */
-static void render_callback(Canvas* const canvas, void* ctx) {
-    GameContext* context = (GameContext*)ctx;
-    furi_mutex_acquire(context->mutex, FuriWaitForever);
-    draw_game(canvas, context->game);
-    furi_mutex_release(context->mutex);
+uint16_t build_flags(void) {
+#ifdef FLIPPER_TD_FIXED_POINT
+    return BUILD_FLAG_FIXED | BUILD_FLAG_MAP(MAP_LAYOUT);
+#else
+    return BUILD_FLAG_MAP(MAP_LAYOUT);
+#endif
 }
 
 /**
- * @brief The input callback function passed to the GUI.
- * @param input_event The event that triggered the callback.
- * @param ctx A void pointer to the event queue.
+ * @brief Mixes a block of bytes into an FNV-1a hash.
+ * @param hash The running hash.
+ * @param data The bytes to mix in.
+ * @param size The number of bytes.
+ * @return The updated hash.
  */
-static void input_callback(InputEvent* input_event, void* ctx) {
-    FuriMessageQueue* event_queue = (FuriMessageQueue*)ctx;
-    furi_assert(event_queue);
-    PluginEvent event = {.type = EventTypeKey, .input = *input_event};
-    furi_message_queue_put(event_queue, &event, FuriWaitForever);
+static uint32_t fnv1a(uint32_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for(size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619U;
+    }
+    return hash;
 }
 
 /**
- * @brief The main entry point for the Tower Defense application.
- * @param p Unused parameter.
- * @return 0 on success.
+ * @brief Folds a slot pool's free ring into a hash, oldest entry first. Its order decides which
+ * slot the next spawn or shot gets.
+ * @param hash The hash so far.
+ * @param pool The pool to hash.
+ * @return The updated hash.
  */
-int32_t flipper_td_app(void* p) {
-    UNUSED(p);
-    FURI_LOG_I("flipper_td", "Starting Tower Defense App");
+static uint32_t slot_pool_hash(uint32_t hash, const SlotPool* pool) {
+    for(int i = 0; i < pool->free_count; i++) {
+        hash = fnv1a(hash, &pool->free[(pool->free_head + i) % pool->capacity], sizeof(uint16_t));
+    }
+    return hash;
+}
 
-    FuriMessageQueue* event_queue = furi_message_queue_alloc(8, sizeof(PluginEvent));
-    GameState* game = malloc(sizeof(GameState));
-    FuriMutex* game_mutex = furi_mutex_alloc(FuriMutexTypeNormal);
-    if(!event_queue || !game || !game_mutex) {
-        FURI_LOG_E("flipper_td", "Failed to allocate game resources");
-        free(game);
-        free(event_queue);
-        free(game_mutex);
-        return 1;
+/**
+ * @brief Hashes everything that influences future ticks, skipping caches and render state.
+ *
+ * Two runs of the same build that hash equal at the same tick will stay identical, which is
+ * what replays use to verify playback.
+ * @param game Pointer to the game state.
+ * @return The 32-bit FNV-1a hash of the simulation state.
+ */
+uint32_t game_state_hash(const GameState* game) {
+    uint32_t hash = 2166136261U;
+    hash = fnv1a(hash, &game->tick, sizeof(game->tick));
+    hash = fnv1a(hash, &game->lives, sizeof(game->lives));
+    hash = fnv1a(hash, &game->gold, sizeof(game->gold));
+    hash = fnv1a(hash, &game->wave, sizeof(game->wave));
+    hash = fnv1a(hash, &game->cursor, sizeof(game->cursor));
+    hash = fnv1a(hash, &game->pre_wave_timer, sizeof(game->pre_wave_timer));
+    hash = fnv1a(hash, &game->wave_spawn_timer, sizeof(game->wave_spawn_timer));
+    hash = fnv1a(hash, &game->wave_spawn_index, sizeof(game->wave_spawn_index));
+    hash = fnv1a(hash, &game->projectiles_dropped, sizeof(game->projectiles_dropped));
+    hash = fnv1a(hash, game->grid, sizeof(game->grid));
+    hash = slot_pool_hash(hash, &game->enemies.slots);
+    // Serials of free slots too, since a shot in flight misses once its target's slot is reused
+    hash = fnv1a(hash, game->enemies.serial, sizeof(game->enemies.serial));
+    for(int i = slot_pool_next(&game->enemies.slots, -1); i >= 0;
+        i = slot_pool_next(&game->enemies.slots, i)) {
+        hash = fnv1a(hash, &i, sizeof(i));
+        hash = fnv1a(hash, &game->enemies.pos[i], sizeof(game->enemies.pos[i]));
+        hash = fnv1a(hash, &game->enemies.progress[i], sizeof(game->enemies.progress[i]));
+        hash = fnv1a(hash, &game->enemies.freeze_timer[i], sizeof(game->enemies.freeze_timer[i]));
+        hash = fnv1a(hash, &game->enemies.hp[i], sizeof(game->enemies.hp[i]));
+        hash = fnv1a(hash, &game->enemies.spawn[i], sizeof(game->enemies.spawn[i]));
+    }
+    hash = slot_pool_hash(hash, &game->projectiles.slots);
+    for(int p = slot_pool_next(&game->projectiles.slots, -1); p >= 0;
+        p = slot_pool_next(&game->projectiles.slots, p)) {
+        hash = fnv1a(hash, &p, sizeof(p));
+        hash = fnv1a(hash, &game->projectiles.x[p], sizeof(game->projectiles.x[p]));
+        hash = fnv1a(hash, &game->projectiles.y[p], sizeof(game->projectiles.y[p]));
+        hash = fnv1a(hash, &game->projectiles.vx[p], sizeof(game->projectiles.vx[p]));
+        hash = fnv1a(hash, &game->projectiles.vy[p], sizeof(game->projectiles.vy[p]));
+        hash = fnv1a(hash, &game->projectiles.damage[p], sizeof(game->projectiles.damage[p]));
+        hash = fnv1a(
+            hash, &game->projectiles.spawn_tick[p], sizeof(game->projectiles.spawn_tick[p]));
+        hash = fnv1a(
+            hash, &game->projectiles.impact_tick[p], sizeof(game->projectiles.impact_tick[p]));
+        hash = fnv1a(hash, &game->projectiles.target[p], sizeof(game->projectiles.target[p]));
+        hash = fnv1a(
+            hash,
+            &game->projectiles.target_serial[p],
+            sizeof(game->projectiles.target_serial[p]));
+        hash = fnv1a(
+            hash, &game->projectiles.tower_type[p], sizeof(game->projectiles.tower_type[p]));
     }
+    return hash;
+}
 
-    init_game_state(game);
-    GameContext game_context = {.mutex = game_mutex, .game = game};
-    ViewPort* view_port = view_port_alloc();
-    view_port_draw_callback_set(view_port, render_callback, &game_context);
-    view_port_input_callback_set(view_port, input_callback, event_queue);
-
-    Gui* gui = furi_record_open("gui");
-    gui_add_view_port(gui, view_port, GuiLayerFullscreen);
-
-    PluginEvent event;
-    while(true) {
-        FuriStatus event_status = furi_message_queue_get(event_queue, &event, 100);
-        furi_mutex_acquire(game_mutex, FuriWaitForever);
-        if(event_status == FuriStatusOk) {
-            if(event.type == EventTypeKey && event.input.type == InputTypePress) {
-                switch(event.input.key) {
-                case InputKeyUp:
-                    if(game->cursor.y > 0) game->cursor.y--;
-                    break;
-                case InputKeyDown:
-                    if(game->cursor.y < GRID_HEIGHT - 1) game->cursor.y++;
-                    break;
-                case InputKeyLeft:
-                    if(game->cursor.x > 0) game->cursor.x--;
-                    break;
-                case InputKeyRight:
-                    if(game->cursor.x < GRID_WIDTH - 1) game->cursor.x++;
-                    break;
-                case InputKeyOk: {
-                    Coord test_path[GRID_WIDTH * GRID_HEIGHT];
-                    int test_path_length = 0;
-                    Coord start = {0, 0};
-                    Coord end = {GRID_WIDTH - 1, GRID_HEIGHT - 1};
-
-                    if(game->grid[game->cursor.x][game->cursor.y] == TOWER_NONE) {
-                        if(game->gold >= 10) {
-                            game->grid[game->cursor.x][game->cursor.y] = TOWER_NORMAL;
-                            if(find_path(game, start, end, test_path, &test_path_length)) {
-                                game->gold -= 10;
-                            } else {
-                                game->grid[game->cursor.x][game->cursor.y] = TOWER_NONE;
-                            }
-                        }
-                    } else {
-                        TowerType current = game->grid[game->cursor.x][game->cursor.y];
-                        TowerType new_type = next_tower_type(current);
-                        game->grid[game->cursor.x][game->cursor.y] = new_type;
-                        if(new_type != TOWER_NONE &&
-                           !find_path(game, start, end, test_path, &test_path_length)) {
-                            game->grid[game->cursor.x][game->cursor.y] = current;
-                        } else if(new_type == TOWER_NONE) {
-                            game->gold += 5; // Sell tower
-                        }
-                    }
-                    break;
-                }
-                case InputKeyBack:
-                    // Exit the app
-                    // To prevent memory leaks, you'd need to break the loop here.
-                    // For now, it's an infinite loop as in the original code.
-                    break;
-                default:
-                    break;
-                }
+/**
+ * @brief Scrolls one axis of the viewport so the cursor stays VIEW_MARGIN cells from its edges.
+ * @param view The viewport origin on this axis.
+ * @param cursor The cursor position on this axis.
+ * @param view_size Cells visible on this axis.
+ * @param map_size Cells in the map on this axis.
+ * @return The new viewport origin, kept inside the map.
+ */
+static int view_follow(int view, int cursor, int view_size, int map_size) {
+    if(cursor < view + VIEW_MARGIN) view = cursor - VIEW_MARGIN;
+    if(cursor > view + view_size - 1 - VIEW_MARGIN) view = cursor - (view_size - 1 - VIEW_MARGIN);
+    return clamp_int(view, 0, map_size - view_size);
+}
+
+/**
+ * @brief Applies a single input event to the game state.
+ * @param game Pointer to the current game state.
+ * @param input The input event to apply. Only key presses have an effect.
+ */
+void game_handle_input(GameState* game, const InputEvent* input) {
+    if(input->type != InputTypePress) return;
+    switch(input->key) {
+    case InputKeyUp:
+        if(game->cursor.y > 0) game->cursor.y--;
+        break;
+    case InputKeyDown:
+        if(game->cursor.y < GRID_HEIGHT - 1) game->cursor.y++;
+        break;
+    case InputKeyLeft:
+        if(game->cursor.x > 0) game->cursor.x--;
+        break;
+    case InputKeyRight:
+        if(game->cursor.x < GRID_WIDTH - 1) game->cursor.x++;
+        break;
+    case InputKeyOk: {
+        TowerType current = get_grid_cell(game, game->cursor.x, game->cursor.y);
+        if(current == TOWER_NONE) {
+            if(game->gold >= 10 && !placement_blocks_path(game, game->cursor.x, game->cursor.y)) {
+                set_grid_cell(game, game->cursor.x, game->cursor.y, TOWER_NORMAL);
+                game->gold -= 10;
+            }
+        } else {
+            // Swapping one tower type for another never changes which cells are free
+            TowerType new_type = next_tower_type(current);
+            set_grid_cell(game, game->cursor.x, game->cursor.y, new_type);
+            if(new_type == TOWER_NONE) {
+                game->gold += 5; // Sell tower
             }
         }
+        break;
+    }
+    default:
+        break;
+    }
+    game->view.x = view_follow(game->view.x, game->cursor.x, VIEW_WIDTH, GRID_WIDTH);
+    game->view.y = view_follow(game->view.y, game->cursor.y, VIEW_HEIGHT, GRID_HEIGHT);
+}
 
-        // Game logic updates
-        if(game->pre_wave_timer > 0) {
-            game->pre_wave_timer--;
-        } else {
-            Wave wave_params = get_wave_params(game->wave);
-            if(game->wave_spawn_index < wave_params.enemy_count) {
-                game->wave_spawn_timer--;
-                if(game->wave_spawn_timer <= 0) {
-                    int i = game->wave_spawn_index++;
-                    game->enemies[i].active = true;
-                    game->enemies[i].hp = wave_params.enemy_hp;
-                    game->enemies[i].path_index = 0;
-                    game->enemies[i].progress = 0.0f;
-                    game->enemies[i].freeze_timer = 0;
-                    game->enemies[i].pos = (Coord){0, 0};
+/**
+ * @brief Advances the simulation by one tick: wave spawning, movement, firing and projectiles.
+ * @param game Pointer to the current game state.
+ */
+void game_tick(GameState* game) {
+    game->tick++;
+    if(game->pre_wave_timer > 0) {
+        game->pre_wave_timer--;
+    } else {
+        Wave wave_params = get_wave_params(game->wave);
+        if(game->wave_spawn_index < wave_params.enemy_count) {
+            game->wave_spawn_timer--;
+            if(game->wave_spawn_timer <= 0) {
+                // With the pool full, the spawn is retried on the next tick
+                int i = slot_pool_acquire(&game->enemies.slots);
+                if(i >= 0) {
+                    // Spawns take turns within a wave
+                    int spawn = game->wave_spawn_index % game->map->spawn_count;
+                    game->wave_spawn_index++;
+                    game->enemies.serial[i]++;
+                    game->enemies.spawn[i] = spawn;
+                    game->enemies.hp[i] = wave_params.enemy_hp;
+                    game->enemies.progress[i] = 0;
+                    game->enemies.freeze_timer[i] = 0;
+                    game->enemies.pos[i] = game->map->spawns[spawn];
                     game->wave_spawn_timer = wave_params.spawn_interval_ticks;
                 }
             }
         }
-        update_enemies(game);
-        update_tower_firing(game);
-        update_projectiles(game);
-        if(game->wave_spawn_index >= get_wave_params(game->wave).enemy_count &&
-           all_enemies_inactive(game)) {
-            game->wave++;
-            spawn_wave(game);
-        }
+    }
+    // Path rebuilds triggered from update_enemies() are timed both there and as ProfilePath
+    uint32_t start = profile_now();
+    update_enemies(game);
+    profiler_record(&game->profiler, ProfileEnemies, start);
+    start = profile_now();
+    update_tower_firing(game);
+    profiler_record(&game->profiler, ProfileTowers, start);
+    start = profile_now();
+    update_projectiles(game);
+    profiler_record(&game->profiler, ProfileProjectiles, start);
+    profiler_tick(&game->profiler);
+    if(game->wave_spawn_index >= get_wave_params(game->wave).enemy_count &&
+       all_enemies_stranded(game)) {
+        game->wave++;
+        spawn_wave(game);
+    }
+}
+
+/**
+ * @brief Applies a batch of input events and then advances the simulation by one tick.
+ * @param game Pointer to the current game state.
+ * @param inputs The input events received since the previous tick, may be NULL if none.
+ * @param input_count The number of events in inputs.
+ */
+void game_step(GameState* game, const InputEvent* inputs, size_t input_count) {
+    for(size_t i = 0; i < input_count; i++) {
+        game_handle_input(game, &inputs[i]);
+    }
+    game_tick(game);
+}
+
+/**
+ * @brief Empties an input ring and clears its counters.
+ * @param ring The ring to reset. No producer or consumer may be using it.
+ */
+void input_ring_init(InputRing* ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+}
+
+/**
+ * @brief Queues an event from the producer thread without blocking.
+ * @param ring The ring to push to.
+ * @param event The event to queue.
+ * @return False if the event was dropped because the ring is full.
+ */
+bool input_ring_push(InputRing* ring, const PluginEvent* event) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if(head - tail == INPUT_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    ring->events[head % INPUT_RING_SIZE] = *event;
+    // Release publishes the event before the consumer can see the new head
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Takes the oldest event on the consumer thread without blocking.
+ * @param ring The ring to pop from.
+ * @param event Filled in with the event.
+ * @return False if the ring is empty.
+ */
+bool input_ring_pop(InputRing* ring, PluginEvent* event) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if(head == tail) return false;
+    *event = ring->events[tail % INPUT_RING_SIZE];
+    // Release hands the slot back only after it has been copied out
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Sets up an empty triple buffer. Until the first publish the reader sees a blank frame.
+ * @param exchange The exchange to initialize. No reader or writer may be using it.
+ */
+void render_exchange_init(RenderExchange* exchange) {
+    memset(exchange->buffers, 0, sizeof(exchange->buffers));
+    exchange->front = 0;
+    atomic_init(&exchange->middle, 1);
+    exchange->back = 2;
+    atomic_init(&exchange->draw_time, 0);
+    render_cache_reset(&exchange->cache);
+}
+
+/**
+ * @brief Returns the buffer the writer may fill, which the reader never touches.
+ * @param exchange The exchange to write to.
+ * @return The snapshot to capture the next frame into.
+ */
+RenderSnapshot* render_exchange_back(RenderExchange* exchange) {
+    return &exchange->buffers[exchange->back];
+}
+
+/**
+ * @brief Hands the filled back buffer to the reader and takes the middle one to fill next.
+ *
+ * A frame the reader has not taken yet is simply replaced, so the writer never waits.
+ * @param exchange The exchange to publish to.
+ */
+void render_exchange_publish(RenderExchange* exchange) {
+    // Release publishes the snapshot, acquire takes back a buffer the reader is done with
+    uint8_t old = atomic_exchange_explicit(
+        &exchange->middle, exchange->back | RENDER_BUFFER_FRESH, memory_order_acq_rel);
+    exchange->back = old & ~RENDER_BUFFER_FRESH;
+}
+
+/**
+ * @brief Returns the newest published frame for the reader, without blocking.
+ * @param exchange The exchange to read from.
+ * @return The snapshot to draw, valid until the next call on this thread.
+ */
+const RenderSnapshot* render_exchange_front(RenderExchange* exchange) {
+    if(atomic_load_explicit(&exchange->middle, memory_order_relaxed) & RENDER_BUFFER_FRESH) {
+        uint8_t old =
+            atomic_exchange_explicit(&exchange->middle, exchange->front, memory_order_acq_rel);
+        exchange->front = old & ~RENDER_BUFFER_FRESH;
+    }
+    return &exchange->buffers[exchange->front];
+}
+
+/**
+ * @brief Resets the fast-forward controller to one tick per frame.
+ * @param turbo The controller to reset. Its enabled flag is left untouched.
+ * @param max_ticks_per_frame Upper bound for the number of ticks run per frame.
+ */
+void turbo_reset(Turbo* turbo, uint32_t max_ticks_per_frame) {
+    turbo->ticks_per_frame = 1;
+    turbo->max_ticks_per_frame = max_ticks_per_frame > 0 ? max_ticks_per_frame : 1;
+}
+
+/**
+ * @brief Retunes the ticks run per frame from how long the last frame's ticks took.
+ *
+ * N is scaled toward the number of ticks that would exactly fill the budget, at most doubling
+ * per frame and averaged with the previous N so timer granularity does not make it oscillate.
+ * elapsed and budget only need to share a unit, so the app can pass milliseconds and the host
+ * nanoseconds.
+ * @param turbo The controller to update.
+ * @param elapsed Time spent running turbo->ticks_per_frame ticks.
+ * @param budget Time available for simulation in one frame.
+ * @return The new number of ticks per frame.
+ */
+uint32_t turbo_adjust(Turbo* turbo, uint32_t elapsed, uint32_t budget) {
+    uint64_t n = turbo->ticks_per_frame;
+    uint64_t target = elapsed > 0 ? n * budget / elapsed : n * 2;
+    if(target > n * 2) target = n * 2;
+    target = (target + n + 1) / 2;
+    if(target < 1) target = 1;
+    if(target > turbo->max_ticks_per_frame) target = turbo->max_ticks_per_frame;
+    turbo->ticks_per_frame = (uint32_t)target;
+    return turbo->ticks_per_frame;
+}
+
+static const char* const profile_section_names[ProfileCount] = {
+    "enemies", "towers", "projectiles", "path", "draw", "snapshot"};
+static const char profile_section_tags[ProfileCount] = {'E', 'T', 'P', 'F', 'D', 'S'};
+
+/**
+ * @brief Clears every profiler window. The overlay setting is reset to hidden.
+ * @param profiler The profiler to reset.
+ */
+void profiler_reset(Profiler* profiler) {
+    memset(profiler, 0, sizeof(*profiler));
+    for(int s = 0; s < ProfileCount; s++) {
+        profiler->current[s].min = UINT32_MAX;
+    }
+    snprintf(profiler->overlay_text, sizeof(profiler->overlay_text), "Profiling...");
+}
+
+/**
+ * @brief Adds one timing sample to the current window.
+ * @param profiler The profiler to record into.
+ * @param section The subsystem that was timed.
+ * @param start The profile_now() value read when the subsystem started.
+ */
+void profiler_record(Profiler* profiler, ProfileSection section, uint32_t start) {
+    profiler_add(profiler, section, profile_now() - start);
+}
+
+/**
+ * @brief Adds a sample that was timed elsewhere, such as on another thread.
+ * @param profiler The profiler to record into.
+ * @param section The subsystem that was timed.
+ * @param elapsed The sample in profile_now() counts.
+ */
+void profiler_add(Profiler* profiler, ProfileSection section, uint32_t elapsed) {
+    ProfileStats* stats = &profiler->current[section];
+    stats->samples++;
+    stats->total += elapsed;
+    if(elapsed < stats->min) stats->min = elapsed;
+    if(elapsed > stats->max) stats->max = elapsed;
+}
+
+/**
+ * @brief Returns the mean sample of a window in profile_now() counts, 0 if it has none.
+ * @param stats The window to average.
+ * @return The average sample.
+ */
+static uint32_t profile_stats_avg(const ProfileStats* stats) {
+    return stats->samples ? (uint32_t)(stats->total / stats->samples) : 0;
+}
 
-        view_port_update(view_port);
-        furi_mutex_release(game_mutex);
+/**
+ * @brief Counts a simulation tick and publishes the window once it is PROFILE_WINDOW_TICKS long.
+ *
+ * Publishing copies the window to last[] and formats the overlay text: the average time of
+ * each section in microseconds, keyed by one letter (E, T, P, F for find_path and flow field
+ * rebuilds, D for draw, S for capturing the render snapshot).
+ * @param profiler The profiler to advance.
+ */
+void profiler_tick(Profiler* profiler) {
+    if(++profiler->window_ticks < PROFILE_WINDOW_TICKS) return;
+    profiler->window_ticks = 0;
+    memcpy(profiler->last, profiler->current, sizeof(profiler->last));
+
+    uint32_t counts_per_us = PROFILE_COUNTS_PER_US;
+    char* text = profiler->overlay_text;
+    size_t left = sizeof(profiler->overlay_text);
+    text[0] = '\0';
+    for(int s = 0; s < ProfileCount; s++) {
+        profiler->current[s] = (ProfileStats){.min = UINT32_MAX};
+        int written = snprintf(
+            text,
+            left,
+            "%c%lu ",
+            profile_section_tags[s],
+            (unsigned long)(profile_stats_avg(&profiler->last[s]) / counts_per_us));
+        if(written < 0 || (size_t)written >= left) break;
+        text += written;
+        left -= written;
     }
+}
 
-    // Cleanup (This part is unreachable in the current code but is good practice)
-    view_port_enabled_set(view_port, false);
-    gui_remove_view_port(gui, view_port);
-    furi_record_close("gui");
-    view_port_free(view_port);
-    furi_message_queue_free(event_queue);
-    furi_mutex_free(game_mutex);
-    free(game);
-    return 0;
+/**
+ * @brief Logs min/avg/max of every section over the last completed window.
+ * @param profiler The profiler to dump.
+ */
+void profiler_log(const Profiler* profiler) {
+    FURI_LOG_I(
+        "flipper_td",
+        "Profile over %d ticks, %lu counts/us:",
+        PROFILE_WINDOW_TICKS,
+        (unsigned long)PROFILE_COUNTS_PER_US);
+    for(int s = 0; s < ProfileCount; s++) {
+        const ProfileStats* stats = &profiler->last[s];
+        FURI_LOG_I(
+            "flipper_td",
+            "  %-11s n=%lu min=%lu avg=%lu max=%lu",
+            profile_section_names[s],
+            (unsigned long)stats->samples,
+            (unsigned long)(stats->samples ? stats->min : 0),
+            (unsigned long)profile_stats_avg(stats),
+            (unsigned long)stats->max);
+    }
 }
@@ -5,6 +5,7 @@
 #include <gui/gui.h>
 #include <input/input.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <math.h>
@@ -19,12 +20,144 @@
 #define SCREEN_HEIGHT     64
 #define STATUS_BAR_HEIGHT 8
 #define CELL_SIZE         8
-#define GRID_WIDTH        (SCREEN_WIDTH / CELL_SIZE)
-#define GRID_HEIGHT       ((SCREEN_HEIGHT - STATUS_BAR_HEIGHT) / CELL_SIZE)
-#define MAX_ENEMIES       32
-#define MAX_PROJECTILES   64
-#define PROJECTILE_SPEED  2.0f
+#define VIEW_WIDTH        (SCREEN_WIDTH / CELL_SIZE) // Cells visible at once
+#define VIEW_HEIGHT       ((SCREEN_HEIGHT - STATUS_BAR_HEIGHT) / CELL_SIZE)
+#define VIEW_MARGIN       1 // Cells kept between the cursor and a scrolling screen edge
+// Map size in cells. Defaults to one screen; larger maps scroll with the cursor.
+#ifndef GRID_WIDTH
+#define GRID_WIDTH VIEW_WIDTH
+#endif
+#ifndef GRID_HEIGHT
+#define GRID_HEIGHT VIEW_HEIGHT
+#endif
+// Spawn and exit layout, an index into map_layouts[] in flipper_td.c
+#ifndef MAP_LAYOUT
+#define MAP_LAYOUT 0
+#endif
+#define MAX_SPAWNS        4
+#define MAX_EXITS         4
+#ifndef MAX_ENEMIES
+#define MAX_ENEMIES 32
+#endif
+#ifndef MAX_PROJECTILES
+#define MAX_PROJECTILES 64
+#endif
+#define PROJECTILE_SPEED  2 // Pixels per tick
+#define PROJECTILE_MAX_FLIGHT_TICKS 32 // Power of two, sizes the impact wheel
+#define SLOT_POOL_MAX     (MAX_ENEMIES > MAX_PROJECTILES ? MAX_ENEMIES : MAX_PROJECTILES)
+#define SLOT_MASK_WORDS   ((SLOT_POOL_MAX + 31) / 32)
 #define PRE_WAVE_TICKS    150
+#define SIM_TICK_MS       100 // Fixed simulation step, independent of input
+#define RENDER_PERIOD_MS  33 // Minimum time between redraw requests
+#define MAX_CATCHUP_TICKS 5 // Ticks run back to back after a stall before time is dropped
+#define INPUT_BATCH_SIZE  8
+#define INPUT_RING_SIZE   16 // Power of two, key events buffered between input and game threads
+#define TURBO_FRAME_BUDGET_MS     20 // Simulation time per fast-forward frame, rest is for drawing
+#define TURBO_MAX_TICKS_PER_FRAME 1024
+#define PROFILE_WINDOW_TICKS      32 // Ticks per profiler window, stats cover the last one
+#define REPLAY_MAX_EVENTS 4096 // 8 KB of key presses, recording stops once full
+#define GRID_CELLS        (GRID_WIDTH * GRID_HEIGHT)
+#define FLOW_UNREACHABLE  0xFFFF
+#define CELL_MASK_WORDS   ((GRID_CELLS + 31) / 32)
+#define CELL_TYPE_MASK    0x07 // Low bits of a packed cell hold its TowerType
+#define CELL_FLAG_RESERVED 0x08 // Spawn or exit, never buildable
+// Bytes of rebuild working memory: the placement DFS's 8 bytes per node plus alignment
+#define SCRATCH_ARENA_SIZE (8 * (GRID_CELLS + 1) + 16)
+#define BACKGROUND_WIDTH  (VIEW_WIDTH * CELL_SIZE)
+#define BACKGROUND_HEIGHT (VIEW_HEIGHT * CELL_SIZE)
+#define BACKGROUND_STRIDE (BACKGROUND_WIDTH / 8)
+#define RENDER_CELL_BLOCKING 0x08 // Snapshot cell flag: a tower here would block the path
+#define RENDER_BUFFER_FRESH  0x04 // RenderExchange.middle flag: published and not yet drawn
+
+// Cell indices are uint16_t with FLOW_UNREACHABLE reserved, and the viewport never overhangs
+_Static_assert(GRID_CELLS < FLOW_UNREACHABLE, "map has too many cells");
+_Static_assert(GRID_WIDTH >= VIEW_WIDTH && GRID_HEIGHT >= VIEW_HEIGHT, "map smaller than screen");
+_Static_assert((INPUT_RING_SIZE & (INPUT_RING_SIZE - 1)) == 0, "ring indices wrap at 2^32");
+
+//================================================================
+// Simulation Scalar
+//================================================================
+
+// Enemy progress, projectile motion and wave speeds use Scalar. Building with
+// FLIPPER_TD_FIXED_POINT switches it from float to Q16.16 fixed point, which keeps every tick
+// in integer registers and gives bit-identical results on the Flipper and on the host.
+#ifdef FLIPPER_TD_FIXED_POINT
+typedef int32_t Scalar;
+#define SCALAR_FRAC_BITS           16
+#define SCALAR_ONE                 ((Scalar)1 << SCALAR_FRAC_BITS)
+#define SCALAR_FROM_INT(i)         ((Scalar)(i) * SCALAR_ONE)
+#define SCALAR_FROM_RATIO(num, den) ((Scalar)((int64_t)(num) * SCALAR_ONE / (den)))
+#define SCALAR_TO_INT(s)           ((int)((s) >> SCALAR_FRAC_BITS))
+#define SCALAR_MUL(a, b)           ((Scalar)(((int64_t)(a) * (b)) >> SCALAR_FRAC_BITS))
+#define SCALAR_DIV(a, b)           ((Scalar)((int64_t)(a) * SCALAR_ONE / (b)))
+#else
+typedef float Scalar;
+#define SCALAR_ONE                 1.0f
+#define SCALAR_FROM_INT(i)         ((float)(i))
+#define SCALAR_FROM_RATIO(num, den) ((float)(num) / (float)(den))
+#define SCALAR_TO_INT(s)           ((int)(s) - ((s) < (int)(s))) // floor without libm
+#define SCALAR_MUL(a, b)           ((a) * (b))
+#define SCALAR_DIV(a, b)           ((a) / (b))
+#endif
+
+// Batch kernels evaluate VECTOR_LANES slots at once with GCC vector extensions when the target
+// has 32-bit-lane SIMD (SSE2 or NEON). The Flipper's Cortex-M4 has none, so it, and any build
+// with FLIPPER_TD_SCALAR_KERNELS, runs the same arithmetic one slot at a time.
+#if !defined(FLIPPER_TD_SCALAR_KERNELS) && (defined(__SSE2__) || defined(__ARM_NEON))
+#define FLIPPER_TD_VECTOR_KERNELS
+#define VECTOR_LANES 4
+typedef Scalar ScalarVec __attribute__((vector_size(VECTOR_LANES * sizeof(Scalar))));
+typedef int32_t IntVec __attribute__((vector_size(VECTOR_LANES * sizeof(int32_t))));
+#endif
+
+//================================================================
+// Profiling Clock
+//================================================================
+
+// profile_now() is a free-running 32-bit counter; differences of two reads are exact across
+// wraparound for intervals shorter than one wrap. The Flipper uses the DWT cycle counter,
+// which the firmware enables at boot, and the host a monotonic nanosecond clock.
+#ifdef FLIPPER_TD_HOST
+#include <host.h>
+#define PROFILE_COUNTS_PER_US 1000
+static inline uint32_t profile_now(void) {
+    return (uint32_t)host_time_ns();
+}
+#else
+#include <furi_hal.h>
+#define PROFILE_COUNTS_PER_US furi_hal_cortex_instructions_per_microsecond()
+static inline uint32_t profile_now(void) {
+    return DWT->CYCCNT;
+}
+#endif
+
+//================================================================
+// Serialization
+//================================================================
+
+// Little-endian field helpers for the replay and snapshot file formats
+static inline void put_u16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static inline void put_u32(uint8_t* out, uint32_t value) {
+    put_u16(out, value & 0xFFFF);
+    put_u16(out + 2, value >> 16);
+}
+
+static inline uint16_t get_u16(const uint8_t* in) {
+    return in[0] | (in[1] << 8);
+}
+
+static inline uint32_t get_u32(const uint8_t* in) {
+    return get_u16(in) | ((uint32_t)get_u16(in + 2) << 16);
+}
+
+// Build options that change simulation results, stored in replay and snapshot headers by
+// build_flags(). Bits 1-7 are left to the file formats for their own flags.
+#define BUILD_FLAG_FIXED     (1 << 0) // FLIPPER_TD_FIXED_POINT
+#define BUILD_FLAG_MAP(layout) ((layout) << 8) // MAP_LAYOUT in bits 8-15
 
 //================================================================
 // Type Definitions
@@ -48,88 +181,384 @@ typedef enum {
     TOWER_FREEZE,
 } TowerType;
 
+// Which enemy in range a tower fires at, set per TowerType in tower_target_policies[]
+typedef enum {
+    TargetFirst, // Closest to an exit
+    TargetLast, // Furthest from every exit
+    TargetStrongest, // Most hp, the first of them on a tie
+    TargetWeakest, // Least hp, the first of them on a tie
+} TargetPolicy;
+
+// What spawn_projectile() does when every projectile slot is live
+typedef enum {
+    PoolFullDropNew, // Discard the new shot
+    PoolFullEvictOldest, // Recycle the slot of the longest-flying projectile
+} PoolFullPolicy;
+
+#ifndef PROJECTILE_POOL_FULL_POLICY
+#define PROJECTILE_POOL_FULL_POLICY PoolFullDropNew
+#endif
+
 // Simple coordinate struct
 typedef struct {
     int x;
     int y;
 } Coord;
 
+// Where enemies enter and leave a map. Every spawn must stay connected to at least one exit.
+typedef struct {
+    const char* name;
+    uint8_t spawn_count;
+    uint8_t exit_count;
+    Coord spawns[MAX_SPAWNS];
+    Coord exits[MAX_EXITS];
+} MapLayout;
+
 // Parameters for scaling enemy properties per wave
 typedef struct {
     int wave_number;
-    float enemy_speed;
+    Scalar enemy_speed;
     int enemy_hp;
     int enemy_count;
     int spawn_interval_ticks;
 } Wave;
 
-// Projectile state
+// Fixed-capacity slot allocator with an O(1) free ring and a live bitmask walked with ctz
+typedef struct {
+    uint16_t capacity;
+    uint16_t live_count;
+    uint16_t free_head;
+    uint16_t free_count;
+    uint32_t live[SLOT_MASK_WORDS]; // Bit per slot, set while the slot is live
+    uint16_t free[SLOT_POOL_MAX]; // FIFO ring of free slots, so released slots are reused last
+} SlotPool;
+
+// Projectile state, stored as a structure of arrays indexed by slot. A projectile's flight is
+// fixed when it is fired: it lands on its target at impact_tick, and until then its position is
+// derived from the tick rather than integrated.
+typedef struct {
+    SlotPool slots;
+    // Impact wheel: bit p of due[t % PROJECTILE_MAX_FLIGHT_TICKS] is set if slot p lands at t
+    uint32_t due[PROJECTILE_MAX_FLIGHT_TICKS][SLOT_MASK_WORDS];
+    // Flight path, only read when drawing: position after n moves is (x, y) + n * (vx, vy)
+    Scalar x[MAX_PROJECTILES];
+    Scalar y[MAX_PROJECTILES];
+    Scalar vx[MAX_PROJECTILES];
+    Scalar vy[MAX_PROJECTILES];
+    uint32_t spawn_tick[MAX_PROJECTILES];
+    // Cold: only read on impact or when the pool is full
+    uint32_t impact_tick[MAX_PROJECTILES];
+    int16_t target[MAX_PROJECTILES]; // Enemy slot the projectile homes on
+    uint16_t target_serial[MAX_PROJECTILES]; // EnemyPool.serial of the target when fired
+    int damage[MAX_PROJECTILES];
+    TowerType tower_type[MAX_PROJECTILES];
+} ProjectilePool;
+
+// Enemy state, stored as a structure of arrays indexed by slot
+typedef struct {
+    SlotPool slots;
+    // Hot: advanced every tick
+    Coord pos[MAX_ENEMIES];
+    Scalar progress[MAX_ENEMIES];
+    int freeze_timer[MAX_ENEMIES];
+    int hp[MAX_ENEMIES];
+    // Cold
+    uint8_t spawn[MAX_ENEMIES]; // Index into MapLayout.spawns the enemy entered from
+    uint16_t serial[MAX_ENEMIES]; // Bumped on every spawn into the slot
+} EnemyPool;
+
+// Cached distance/flow field toward the nearest exit, rebuilt only when the grid changes
+typedef struct {
+    uint32_t generation; // grid_generation this field was built from
+    uint16_t dist[GRID_CELLS]; // Steps to the nearest exit, FLOW_UNREACHABLE if cut off
+    uint16_t next[GRID_CELLS]; // Cell index of the next step toward that exit
+} FlowField;
+
+// Cells where a new tower would cut a spawn off from every exit, rebuilt on grid changes
+typedef struct {
+    uint32_t generation; // grid_generation this index was built from
+    uint8_t blocking[(GRID_CELLS + 7) / 8]; // Bitset indexed by cell
+} PlacementIndex;
+
+// Live enemies in path order and bucketed by grid cell, rebuilt once per tick at the end of
+// update_enemies(). order[] is kept from one tick to the next and re-sorted every tick with an
+// insertion sort, which is linear while no enemy overtakes another and quadratic at worst.
+// Each bucket lists its enemies in order[] order.
 typedef struct {
-    float x;
-    float y;
-    float vx;
-    float vy;
-    int damage;
-    TowerType tower_type;
-    bool active;
-} Projectile;
+    uint16_t order[MAX_ENEMIES]; // Live enemy slots, closest to an exit first
+    uint16_t rank[MAX_ENEMIES]; // Position of each live slot in order[]
+    int count; // Entries in order[]
+    int16_t head[GRID_CELLS]; // First enemy slot in the cell, -1 if empty
+    int16_t next[MAX_ENEMIES]; // Next enemy slot in the same cell, -1 at the end
+    // Bit per cell with a non-empty bucket, plus a zero word so any run of up to 32 cells can
+    // be read as one 64-bit window
+    uint32_t occupied[CELL_MASK_WORDS + 1];
+} EnemyIndex;
 
-// Enemy state
+// Towers and their reach, rebuilt only when the grid changes. A tower's square range is one
+// run of consecutive idx() cells per column, so firing tests those runs against
+// EnemyIndex.occupied instead of rescanning every cell in range.
 typedef struct {
-    Coord pos;
-    int hp;
-    int path_index;
-    float progress;
-    int freeze_timer;
-    bool active;
-} Enemy;
+    uint32_t generation; // grid_generation the index was built from
+    int count; // Number of towers
+    uint16_t cell[GRID_CELLS]; // Tower cells in idx() order
+    uint8_t range[GRID_CELLS]; // Chebyshev radius of each tower
+} CoverageIndex;
 
-// Event structure passed in the message queue
+// Bump allocator for the working memory of path queries and grid cache rebuilds, kept off the
+// 4 KB app stack so map size is bounded by heap rather than stack. Each user allocates from a
+// mark and releases back to it before returning, so the arena is empty between calls and
+// steady state never touches the heap.
+typedef struct {
+    uint32_t bytes[SCRATCH_ARENA_SIZE / sizeof(uint32_t)]; // Word aligned storage
+    size_t used;
+    size_t peak; // Most bytes ever in use at once, to check SCRATCH_ARENA_SIZE against
+} ScratchArena;
+
+// Pre-rendered layers for render_snapshot_draw(), so a frame only draws what moves
+typedef struct {
+    uint32_t generation; // grid_generation the background was drawn from
+    Coord view; // Viewport the background was drawn for
+    // Grid lines, towers and placement shading as a 1-bit XBM, LSB is the leftmost pixel
+    uint8_t background[BACKGROUND_STRIDE * BACKGROUND_HEIGHT];
+    // The background with the current frame's enemies blitted in, drawn in one call
+    uint8_t frame[BACKGROUND_STRIDE * BACKGROUND_HEIGHT];
+    int status_lives; // Stats the status text was formatted from
+    int status_gold;
+    int status_wave;
+    char status[32];
+} RenderCache;
+
+// Everything one frame shows, copied out of the game by render_snapshot_capture() so it can
+// be drawn without reading GameState. Everything in it is already culled to the view.
+typedef struct {
+    uint32_t grid_generation; // Together with view, identifies cells[]
+    Coord view;
+    uint8_t cells[VIEW_WIDTH * VIEW_HEIGHT]; // Row-major visible cells, TowerType or flags
+    int lives;
+    int gold;
+    int wave;
+    bool overlay; // Show overlay_text in place of the status text
+    char overlay_text[32];
+    uint32_t turbo_ticks_per_frame; // Fast-forward badge, 0 when off; filled in by the app
+    Coord cursor; // Top-left pixel of the cursor box
+    uint16_t enemy_count;
+    uint16_t projectile_count;
+    Coord enemies[MAX_ENEMIES]; // View cells holding an enemy
+    Coord projectiles[MAX_PROJECTILES]; // Screen pixels
+} RenderSnapshot;
+
+// Lock-free triple buffer of snapshots between the game loop and the GUI thread. The writer
+// fills buffers[back] and swaps it with middle; the reader swaps front with middle only when
+// RENDER_BUFFER_FRESH is set. Neither side waits, and the reader always sees a whole frame.
+typedef struct {
+    RenderSnapshot buffers[3];
+    _Atomic uint8_t middle; // Last published buffer, with RENDER_BUFFER_FRESH until taken
+    uint8_t back; // Writer only: the buffer being captured into
+    uint8_t front; // Reader only: the buffer being drawn
+    _Atomic uint32_t draw_time; // Reader's last draw in profile_now() counts, 0 once taken
+    RenderCache cache; // Reader only
+} RenderExchange;
+
+// Frame and cache for draw_game(), owned by the caller that draws on its own thread. The app
+// draws through a RenderExchange instead and never needs one.
+typedef struct {
+    RenderSnapshot snapshot;
+    RenderCache cache;
+} DrawContext;
+
+// Event structure passed from the input callback to the game loop
 typedef struct {
     EventType type;
     InputEvent input;
 } PluginEvent;
 
+// Lock-free single-producer, single-consumer queue of events. The input callback pushes and
+// the game loop pops, and neither ever blocks: a full ring drops the new event.
+typedef struct {
+    PluginEvent events[INPUT_RING_SIZE];
+    _Atomic uint32_t head; // Events pushed so far, written by the producer only
+    _Atomic uint32_t tail; // Events popped so far, written by the consumer only
+    _Atomic uint32_t dropped; // Events lost to a full ring
+} InputRing;
+
+// Compact (tick, key) log of a game, replayable through game_tick(). Each event is one
+// uint16_t: the tick delta since the previous event in the high 13 bits and the key in the
+// low 3 bits. REPLAY_KEY_SKIP advances the tick without a key press.
+typedef struct {
+    uint16_t flags; // build_flags() of the recording build, plus REPLAY_FLAG_RESUMED
+    uint32_t initial_hash; // game_state_hash() where the recording started
+    uint32_t end_tick; // Tick the recording stopped at
+    uint32_t final_hash; // game_state_hash() at end_tick
+    uint32_t last_tick; // Tick of the last recorded event, base for the next delta
+    bool finished;
+    size_t count;
+    size_t capacity;
+    uint16_t* events;
+} Replay;
+
+// Fast-forward controller: how many ticks fit in one rendered frame, measured as it runs
+typedef struct {
+    bool enabled;
+    uint32_t ticks_per_frame; // Current N, the achievable tick rate per frame budget
+    uint32_t max_ticks_per_frame;
+} Turbo;
+
+// Subsystems timed by the tick profiler
+typedef enum {
+    ProfileEnemies, // update_enemies()
+    ProfileTowers, // update_tower_firing()
+    ProfileProjectiles, // update_projectiles()
+    ProfilePath, // find_path() and the flow field / placement index rebuilds
+    ProfileDraw, // render_snapshot_draw()
+    ProfileSnapshot, // render_snapshot_capture() and publishing it to the GUI thread
+    ProfileCount,
+} ProfileSection;
+
+// Min/avg/max accumulator for one section over one window, in profile_now() counts
+typedef struct {
+    uint32_t samples;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+} ProfileStats;
+
+// Rolling per-subsystem timings. Samples accumulate into current[] and are published to
+// last[] every PROFILE_WINDOW_TICKS ticks, along with the overlay text.
+typedef struct {
+    ProfileStats current[ProfileCount];
+    ProfileStats last[ProfileCount];
+    uint32_t window_ticks;
+    bool overlay; // Show overlay_text in place of the status bar
+    char overlay_text[32];
+} Profiler;
+
 // Game state containing all runtime data
 struct GameState {
     int lives;
     int gold;
     int wave;
-    TowerType grid[GRID_WIDTH][GRID_HEIGHT];
+    const MapLayout* map; // Spawns and exits, MAP_LAYOUT
+    uint8_t grid[(GRID_CELLS + 1) / 2]; // 4 bits per cell in idx() order, see CELL_TYPE_MASK
+    uint32_t grid_generation; // Bumped by every grid mutation
+    FlowField flow;
+    PlacementIndex placement;
+    CoverageIndex coverage;
+    ScratchArena scratch;
     Coord cursor;
-    Enemy enemies[MAX_ENEMIES];
-    Projectile projectiles[MAX_PROJECTILES];
+    Coord view; // Top-left map cell on screen, follows the cursor
+    EnemyPool enemies;
+    EnemyIndex enemy_index;
+    ProjectilePool projectiles;
+    uint32_t projectiles_dropped; // Shots lost to a full projectile pool
+    uint32_t tick;
     int pre_wave_timer;
     int wave_spawn_timer;
     int wave_spawn_index;
+    Profiler profiler;
 };
 
 //================================================================
 // Function Prototypes
 //================================================================
 
+// Scratch arena
+void scratch_reset(ScratchArena* arena);
+void* scratch_alloc(ScratchArena* arena, size_t size);
+void scratch_release(ScratchArena* arena, size_t mark);
+
+// Slot pools
+void slot_pool_init(SlotPool* pool, int capacity);
+int slot_pool_acquire(SlotPool* pool);
+void slot_pool_release(SlotPool* pool, int slot);
+bool slot_pool_is_live(const SlotPool* pool, int slot);
+
 // Wave logic
 Wave get_wave_params(int wave_number);
 void spawn_wave(GameState* game);
-bool all_enemies_inactive(GameState* game);
+bool all_enemies_stranded(GameState* game);
 
 // Tower logic
 TowerType next_tower_type(TowerType current);
 void update_tower_firing(GameState* game);
+void coverage_index_update(GameState* game);
 
 // Enemy logic
 void update_enemies(GameState* game);
+void enemy_index_rebuild(GameState* game);
 
 // Projectile logic
-void spawn_projectile(GameState* game, int tx, int ty, TowerType type, Coord target);
+void spawn_projectile(GameState* game, int tx, int ty, TowerType type, int target);
 void update_projectiles(GameState* game);
 
+// Grid
+TowerType get_grid_cell(const GameState* game, int x, int y);
+void set_grid_cell(GameState* game, int x, int y, TowerType type);
+
 // Pathfinding
 bool find_path(GameState* game, Coord start, Coord end, Coord path[], int* path_length);
+void flow_field_update(GameState* game);
+void placement_index_update(GameState* game);
+bool placement_blocks_path(GameState* game, int x, int y);
+
+// Simulation step, shared by the app and the host build
+void game_handle_input(GameState* game, const InputEvent* input);
+void game_tick(GameState* game);
+void game_step(GameState* game, const InputEvent* inputs, size_t input_count);
+
+// Input ring
+void input_ring_init(InputRing* ring);
+bool input_ring_push(InputRing* ring, const PluginEvent* event);
+bool input_ring_pop(InputRing* ring, PluginEvent* event);
+
+// Rendering
+void render_cache_reset(RenderCache* cache);
+int projectile_dots_scalar(const GameState* game, int first, Coord* dots);
+int projectile_dots(const GameState* game, Coord* dots);
+void render_snapshot_capture(GameState* game, RenderSnapshot* snapshot);
+void render_snapshot_draw(Canvas* canvas, const RenderSnapshot* snapshot, RenderCache* cache);
+void render_exchange_init(RenderExchange* exchange);
+RenderSnapshot* render_exchange_back(RenderExchange* exchange);
+void render_exchange_publish(RenderExchange* exchange);
+const RenderSnapshot* render_exchange_front(RenderExchange* exchange);
+
+// Fast-forward
+void turbo_reset(Turbo* turbo, uint32_t max_ticks_per_frame);
+uint32_t turbo_adjust(Turbo* turbo, uint32_t elapsed, uint32_t budget);
+
+// Replay recording and playback
+uint16_t build_flags(void);
+uint32_t game_state_hash(const GameState* game);
+Replay* replay_alloc(size_t capacity);
+void replay_free(Replay* replay);
+void replay_begin(Replay* replay, const GameState* game, bool resumed);
+bool replay_record(Replay* replay, uint32_t tick, const InputEvent* input);
+void replay_finish(Replay* replay, const GameState* game);
+bool replay_play(
+    const Replay* replay,
+    GameState* game,
+    const char* snapshot_path,
+    Canvas* canvas,
+    DrawContext* draw);
+bool replay_save(const Replay* replay, const char* path);
+bool replay_load(Replay* replay, const char* path);
+
+// Save and resume
+bool snapshot_save(const GameState* game, const char* path);
+bool snapshot_load(GameState* game, const char* path);
+bool snapshot_remove(const char* path);
+
+// Profiler
+void profiler_reset(Profiler* profiler);
+void profiler_record(Profiler* profiler, ProfileSection section, uint32_t start);
+void profiler_add(Profiler* profiler, ProfileSection section, uint32_t elapsed);
+void profiler_tick(Profiler* profiler);
+void profiler_log(const Profiler* profiler);
 
 // Main game loop and state management
 void init_game_state(GameState* game);
-void draw_game(Canvas* canvas, GameState* game);
+void draw_context_init(DrawContext* draw);
+void draw_game(Canvas* canvas, GameState* game, DrawContext* draw);
 int32_t flipper_td_app(void* p);
 
 #endif // FLIPPER_TD_H
\ No newline at end of file
@@ -0,0 +1,328 @@
+#include "flipper_td.h"
+
+#include <storage/storage.h>
+#include <string.h>
+
+#define REPLAY_PATH       APP_DATA_PATH("last.replay")
+#define REPLAY_START_PATH APP_DATA_PATH("last_start.snapshot") // Where a resumed replay starts
+#define SNAPSHOT_PATH     APP_DATA_PATH("save.snapshot")
+#define INPUT_FLAG        (1 << 0) // Thread flag raised on the game thread when input is queued
+
+// What the input callback needs to hand events to the game loop
+typedef struct {
+    InputRing ring;
+    FuriThreadId game_thread;
+} InputContext;
+
+/**
+ * @brief The render callback function passed to the GUI. Draws the newest published frame
+ * and never waits on the game thread, which may be mid-tick.
+ * @param canvas The canvas to draw on.
+ * @param ctx A void pointer to the RenderExchange.
+ */
+static void render_callback(Canvas* const canvas, void* ctx) {
+    RenderExchange* render = (RenderExchange*)ctx;
+    uint32_t draw_start = profile_now();
+    const RenderSnapshot* snapshot = render_exchange_front(render);
+    render_snapshot_draw(canvas, snapshot, &render->cache);
+    if(snapshot->turbo_ticks_per_frame) {
+        // Inverted badge with the current ticks per frame
+        char badge[12];
+        snprintf(badge, sizeof(badge), "x%lu", snapshot->turbo_ticks_per_frame);
+        canvas_draw_box(canvas, SCREEN_WIDTH - 24, 0, 24, STATUS_BAR_HEIGHT);
+        canvas_set_color(canvas, ColorWhite);
+        canvas_draw_str_aligned(canvas, SCREEN_WIDTH - 1, 0, AlignRight, AlignTop, badge);
+        canvas_set_color(canvas, ColorBlack);
+    }
+    // The game thread folds this into its profiler, which only it may touch
+    atomic_store_explicit(&render->draw_time, profile_now() - draw_start, memory_order_relaxed);
+}
+
+/**
+ * @brief Captures the current frame on the game thread and hands it to the GUI thread.
+ * @param render The exchange shared with render_callback().
+ * @param game Pointer to the current game state.
+ * @param turbo The fast-forward controller, for the badge.
+ */
+static void publish_frame(RenderExchange* render, GameState* game, const Turbo* turbo) {
+    uint32_t capture_start = profile_now();
+    RenderSnapshot* snapshot = render_exchange_back(render);
+    render_snapshot_capture(game, snapshot);
+    snapshot->turbo_ticks_per_frame = turbo->enabled ? turbo->ticks_per_frame : 0;
+    render_exchange_publish(render);
+    profiler_record(&game->profiler, ProfileSnapshot, capture_start);
+    uint32_t drawn = atomic_exchange_explicit(&render->draw_time, 0, memory_order_relaxed);
+    if(drawn) profiler_add(&game->profiler, ProfileDraw, drawn);
+}
+
+/**
+ * @brief Tells whether the game loop acts on an input event at all.
+ *
+ * Up, Down and Back act when a press ends, on its short or long type, since a long press
+ * means something else: the profiler for Up and Down, exiting rather than fast-forward for
+ * Back. The other keys act on the press itself. Releases and repeats are never used.
+ * @param input The event to test.
+ * @return True if the event should be queued for the game loop.
+ */
+static bool input_event_used(const InputEvent* input) {
+    switch(input->key) {
+    case InputKeyUp:
+    case InputKeyDown:
+    case InputKeyBack:
+        return input->type == InputTypeShort || input->type == InputTypeLong;
+    default:
+        return input->type == InputTypePress;
+    }
+}
+
+/**
+ * @brief The input callback function passed to the GUI. Never blocks the input service: an
+ * event the game uses goes into the lock-free ring and the game thread is woken with a thread
+ * flag. Other events are left out, so a held key's repeats cannot fill the ring.
+ * @param input_event The event that triggered the callback.
+ * @param ctx A void pointer to the InputContext.
+ */
+static void input_callback(InputEvent* input_event, void* ctx) {
+    InputContext* input = (InputContext*)ctx;
+    furi_assert(input);
+    if(!input_event_used(input_event)) return;
+    PluginEvent event = {.type = EventTypeKey, .input = *input_event};
+    if(input_ring_push(&input->ring, &event)) {
+        furi_thread_flags_set(input->game_thread, INPUT_FLAG);
+    }
+}
+
+/**
+ * @brief Logs how close the game thread has come to running out of stack and scratch arena.
+ *
+ * The stack figure is FreeRTOS's high-water mark: bytes of the stack_size in application.fam
+ * that have never been written since the app started.
+ * @param game Pointer to the current game state.
+ */
+static void log_memory_headroom(const GameState* game) {
+    FURI_LOG_I(
+        "flipper_td",
+        "Stack: %lu bytes never used. Scratch arena: peak %lu of %lu bytes",
+        (unsigned long)furi_thread_get_stack_space(furi_thread_get_current_id()),
+        (unsigned long)game->scratch.peak,
+        (unsigned long)sizeof(game->scratch.bytes));
+}
+
+/**
+ * @brief Plays back the last saved replay at full speed without rendering and logs the timing.
+ *
+ * Launch the app with the argument "replay" to run this instead of the game. The same run can
+ * then be timed on the device before and after a change to the simulation.
+ * @return 0 if the replay loaded and reproduced its recorded end state, 1 otherwise.
+ */
+static int32_t flipper_td_play_last_replay(void) {
+    Replay* replay = replay_alloc(REPLAY_MAX_EVENTS);
+    GameState* game = malloc(sizeof(GameState));
+    int32_t result = 1;
+    if(!replay || !game) {
+        FURI_LOG_E("flipper_td", "Failed to allocate replay resources");
+    } else if(!replay_load(replay, REPLAY_PATH)) {
+        FURI_LOG_E("flipper_td", "No usable replay at %s", REPLAY_PATH);
+    } else {
+        uint32_t start = furi_get_tick();
+        bool match = replay_play(replay, game, REPLAY_START_PATH, NULL, NULL);
+        uint32_t elapsed = furi_get_tick() - start;
+        FURI_LOG_I(
+            "flipper_td",
+            "Replay %s: %lu ticks in %lu ms",
+            match ? "matched" : "diverged",
+            game->tick,
+            elapsed);
+        result = match ? 0 : 1;
+    }
+    if(replay) replay_free(replay);
+    free(game);
+    return result;
+}
+
+/**
+ * @brief The main entry point for the Tower Defense application.
+ * @param p Launch arguments; "replay" plays back the last recorded game instead.
+ * @return 0 on success.
+ */
+int32_t flipper_td_app(void* p) {
+    if(p && strcmp((const char*)p, "replay") == 0) return flipper_td_play_last_replay();
+    FURI_LOG_I("flipper_td", "Starting Tower Defense App");
+
+    InputContext* input = malloc(sizeof(InputContext));
+    GameState* game = malloc(sizeof(GameState));
+    RenderExchange* render = malloc(sizeof(RenderExchange));
+    Replay* replay = replay_alloc(REPLAY_MAX_EVENTS);
+    if(!input || !game || !render || !replay) {
+        FURI_LOG_E("flipper_td", "Failed to allocate game resources");
+        free(game);
+        free(input);
+        free(render);
+        if(replay) replay_free(replay);
+        return 1;
+    }
+
+    // A resumed game is replayed from a copy of the snapshot it started from, since the save
+    // itself is overwritten on exit. If the copy cannot be written the session is not recorded
+    // and the previous replay is kept.
+    bool resumed = snapshot_load(game, SNAPSHOT_PATH);
+    bool recording = !resumed || snapshot_save(game, REPLAY_START_PATH);
+    if(resumed) {
+        FURI_LOG_I("flipper_td", "Resumed wave %d from %s", game->wave, SNAPSHOT_PATH);
+    }
+    if(recording) {
+        replay_begin(replay, game, resumed);
+    } else {
+        FURI_LOG_W("flipper_td", "Failed to save %s, not recording", REPLAY_START_PATH);
+    }
+    Turbo turbo = {.enabled = false};
+    turbo_reset(&turbo, TURBO_MAX_TICKS_PER_FRAME);
+    // Only this thread touches the game; the GUI thread draws published snapshots of it
+    render_exchange_init(render);
+    publish_frame(render, game, &turbo);
+    ViewPort* view_port = view_port_alloc();
+    view_port_draw_callback_set(view_port, render_callback, render);
+    input_ring_init(&input->ring);
+    input->game_thread = furi_thread_get_current_id();
+    view_port_input_callback_set(view_port, input_callback, input);
+
+    Gui* gui = furi_record_open("gui");
+    gui_add_view_port(gui, view_port, GuiLayerFullscreen);
+
+    // Fixed-timestep scheduler: the simulation advances once per SIM_TICK_MS of wall time no
+    // matter how many keys arrive, input is applied in batches between ticks, and redraws are
+    // requested at most once per RENDER_PERIOD_MS. In fast-forward the tick clock is ignored:
+    // every frame runs turbo.ticks_per_frame ticks and draws once, and that N is retuned from
+    // the measured time so the ticks fill TURBO_FRAME_BUDGET_MS.
+    uint32_t tick_period = furi_ms_to_ticks(SIM_TICK_MS);
+    uint32_t render_period = furi_ms_to_ticks(RENDER_PERIOD_MS);
+    uint32_t turbo_budget = furi_ms_to_ticks(TURBO_FRAME_BUDGET_MS);
+    uint32_t next_tick = furi_get_tick() + tick_period;
+    uint32_t last_render = furi_get_tick() - render_period;
+    bool render_pending = true;
+    bool running = true;
+    PluginEvent event;
+    while(running) {
+        uint32_t now = furi_get_tick();
+        uint32_t deadline = next_tick;
+        if(render_pending && (int32_t)(last_render + render_period - deadline) < 0) {
+            deadline = last_render + render_period;
+        }
+        int32_t timeout = (int32_t)(deadline - now);
+
+        // Sleep until input is flagged or the next deadline, then drain without waiting. A
+        // flag raised after the ring was found empty stays set, so no wake-up is lost.
+        InputEvent inputs[INPUT_BATCH_SIZE];
+        size_t input_count = 0;
+        uint32_t wait = timeout > 0 ? (uint32_t)timeout : 0;
+        while(input_count < INPUT_BATCH_SIZE) {
+            if(!input_ring_pop(&input->ring, &event)) {
+                if(wait == 0) break;
+                furi_thread_flags_wait(INPUT_FLAG, FuriFlagWaitAny, wait);
+                wait = 0;
+                continue;
+            }
+            wait = 0;
+            if(event.type != EventTypeKey) continue;
+            if(event.input.key == InputKeyBack && event.input.type == InputTypeLong) {
+                running = false;
+                break;
+            }
+            if(event.input.key == InputKeyBack && event.input.type == InputTypeShort) {
+                turbo.enabled = !turbo.enabled;
+                if(turbo.enabled) {
+                    turbo_reset(&turbo, TURBO_MAX_TICKS_PER_FRAME);
+                } else {
+                    FURI_LOG_I(
+                        "flipper_td",
+                        "Fast-forward reached %lu ticks/frame",
+                        turbo.ticks_per_frame);
+                }
+                render_pending = true;
+                continue;
+            }
+            if(event.input.type == InputTypeLong &&
+               (event.input.key == InputKeyUp || event.input.key == InputKeyDown)) {
+                // Long Up toggles the profiler overlay, long Down dumps the last window
+                if(event.input.key == InputKeyUp) {
+                    game->profiler.overlay = !game->profiler.overlay;
+                } else {
+                    profiler_log(&game->profiler);
+                    log_memory_headroom(game);
+                }
+                render_pending = true;
+                continue;
+            }
+            if(event.input.key == InputKeyUp || event.input.key == InputKeyDown) {
+                // A press may still turn into a long one, so the cursor moves when a short
+                // press ends rather than when it starts
+                if(event.input.type != InputTypeShort) continue;
+                event.input.type = InputTypePress;
+            }
+            inputs[input_count++] = event.input;
+        }
+
+        now = furi_get_tick();
+        uint32_t ticks_due = 0;
+        if(turbo.enabled) {
+            if((int32_t)(now - last_render) >= (int32_t)render_period) {
+                ticks_due = turbo.ticks_per_frame;
+            }
+            render_pending = true;
+            next_tick = now + tick_period;
+        } else {
+            while((int32_t)(now - next_tick) >= 0 && ticks_due < MAX_CATCHUP_TICKS) {
+                next_tick += tick_period;
+                ticks_due++;
+            }
+            if((int32_t)(now - next_tick) >= 0) next_tick = now + tick_period;
+        }
+
+        if(input_count > 0 || ticks_due > 0) {
+            uint32_t sim_start = furi_get_tick();
+            for(size_t i = 0; i < input_count; i++) {
+                // Once the log is full, close it at the state before this input
+                if(!replay_record(replay, game->tick, &inputs[i])) replay_finish(replay, game);
+                game_handle_input(game, &inputs[i]);
+            }
+            for(uint32_t i = 0; i < ticks_due; i++) {
+                game_tick(game);
+            }
+            if(turbo.enabled && ticks_due > 0) {
+                turbo_adjust(&turbo, furi_get_tick() - sim_start, turbo_budget);
+            }
+            render_pending = true;
+        }
+
+        if(render_pending && (int32_t)(now - last_render) >= (int32_t)render_period) {
+            publish_frame(render, game, &turbo);
+            view_port_update(view_port);
+            last_render = now;
+            render_pending = false;
+        }
+    }
+
+    if(recording) {
+        replay_finish(replay, game);
+        if(!replay_save(replay, REPLAY_PATH)) {
+            FURI_LOG_W("flipper_td", "Failed to save replay to %s", REPLAY_PATH);
+        }
+    }
+    replay_free(replay);
+    log_memory_headroom(game);
+    // A lost game is not worth resuming
+    if(game->lives > 0 ? !snapshot_save(game, SNAPSHOT_PATH) : !snapshot_remove(SNAPSHOT_PATH)) {
+        FURI_LOG_W("flipper_td", "Failed to update %s", SNAPSHOT_PATH);
+    }
+
+    view_port_enabled_set(view_port, false);
+    gui_remove_view_port(gui, view_port);
+    furi_record_close("gui");
+    view_port_free(view_port);
+    // The view port is gone, so neither callback can touch the ring or the exchange any more
+    FURI_LOG_I("flipper_td", "Input ring: %lu dropped", atomic_load(&input->ring.dropped));
+    free(input);
+    free(render);
+    free(game);
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include "flipper_td.h"
+
+#include <storage/storage.h>
+
+#define REPLAY_MAGIC          0x52445446 // "FTDR"
+#define REPLAY_VERSION        1
+#define REPLAY_HEADER_SIZE    32
+#define REPLAY_KEY_BITS       3
+#define REPLAY_KEY_SKIP       7
+#define REPLAY_MAX_DELTA      (0xFFFF >> REPLAY_KEY_BITS)
+#define REPLAY_FLAG_RESUMED   (1 << 1) // Starts from a snapshot, not a new game
+#define REPLAY_IO_CHUNK       64
+
+/**
+ * @brief Allocates an empty replay log.
+ * @param capacity The maximum number of encoded events the log can hold.
+ * @return The new replay, or NULL if allocation failed.
+ */
+Replay* replay_alloc(size_t capacity) {
+    Replay* replay = malloc(sizeof(Replay));
+    if(!replay) return NULL;
+    replay->events = malloc(capacity * sizeof(uint16_t));
+    if(!replay->events) {
+        free(replay);
+        return NULL;
+    }
+    replay->capacity = capacity;
+    replay->count = 0;
+    replay->finished = true;
+    return replay;
+}
+
+/**
+ * @brief Frees a replay log.
+ * @param replay The replay to free.
+ */
+void replay_free(Replay* replay) {
+    free(replay->events);
+    free(replay);
+}
+
+/**
+ * @brief Starts recording from the current game state.
+ * @param replay The replay to record into.
+ * @param game Pointer to the game state, as left by init_game_state() or snapshot_load().
+ * @param resumed True if the game was loaded from a snapshot. That snapshot must be kept with
+ * the replay, since playback starts from it.
+ */
+void replay_begin(Replay* replay, const GameState* game, bool resumed) {
+    replay->flags = build_flags() | (resumed ? REPLAY_FLAG_RESUMED : 0);
+    replay->initial_hash = game_state_hash(game);
+    replay->end_tick = game->tick;
+    replay->final_hash = replay->initial_hash;
+    replay->last_tick = game->tick;
+    replay->finished = false;
+    replay->count = 0;
+}
+
+/**
+ * @brief Appends a key press to the log. Events other than presses do not affect the game and
+ * are skipped.
+ *
+ * The press must be recorded before it is applied, at the tick it is applied on.
+ * @param replay The replay to record into.
+ * @param tick The game tick the input is applied at.
+ * @param input The input event.
+ * @return False if the log is full or finished, in which case the caller should finish it
+ * before applying the input.
+ */
+bool replay_record(Replay* replay, uint32_t tick, const InputEvent* input) {
+    if(replay->finished) return false;
+    if(input->type != InputTypePress) return true;
+
+    uint32_t delta = tick - replay->last_tick;
+    size_t needed = 1 + delta / REPLAY_MAX_DELTA;
+    if(replay->count + needed > replay->capacity) return false;
+    while(delta >= REPLAY_MAX_DELTA) {
+        replay->events[replay->count++] = (REPLAY_MAX_DELTA << REPLAY_KEY_BITS) | REPLAY_KEY_SKIP;
+        delta -= REPLAY_MAX_DELTA;
+    }
+    replay->events[replay->count++] = (delta << REPLAY_KEY_BITS) | input->key;
+    replay->last_tick = tick;
+    return true;
+}
+
+/**
+ * @brief Stops recording and stores the end state for verification. Does nothing if the
+ * replay is already finished.
+ * @param replay The replay being recorded.
+ * @param game Pointer to the game state at the end of the recording.
+ */
+void replay_finish(Replay* replay, const GameState* game) {
+    if(replay->finished) return;
+    replay->end_tick = game->tick;
+    replay->final_hash = game_state_hash(game);
+    replay->finished = true;
+}
+
+/**
+ * @brief Replays a log through game_handle_input() and game_tick(), from a new game or from
+ * the snapshot a resumed recording started at.
+ * @param replay The replay to play back.
+ * @param game The game state to play into. It is reinitialized or loaded first.
+ * @param snapshot_path The snapshot a resumed recording started from. Not used for a recording
+ * of a new game, and may be NULL then.
+ * @param canvas The canvas to draw every tick on, or NULL to run without rendering.
+ * @param draw The draw context for canvas. Not used without a canvas, and may be NULL then.
+ * @return True if the initial and final state hashes match the recording.
+ */
+bool replay_play(
+    const Replay* replay,
+    GameState* game,
+    const char* snapshot_path,
+    Canvas* canvas,
+    DrawContext* draw) {
+    if(replay->flags & REPLAY_FLAG_RESUMED) {
+        if(!snapshot_path || !snapshot_load(game, snapshot_path)) return false;
+    } else {
+        init_game_state(game);
+    }
+    if((replay->flags & ~REPLAY_FLAG_RESUMED) != build_flags() ||
+       game_state_hash(game) != replay->initial_hash) {
+        return false;
+    }
+    if(canvas) draw_context_init(draw);
+
+    size_t pos = 0;
+    uint32_t event_tick = game->tick;
+    InputEvent input = {.type = InputTypePress};
+    while(true) {
+        while(pos < replay->count) {
+            uint16_t event = replay->events[pos];
+            uint32_t tick = event_tick + (event >> REPLAY_KEY_BITS);
+            if(tick != game->tick) break;
+            event_tick = tick;
+            pos++;
+            if((event & REPLAY_KEY_SKIP) == REPLAY_KEY_SKIP) continue;
+            input.key = event & REPLAY_KEY_SKIP;
+            game_handle_input(game, &input);
+        }
+        if(game->tick == replay->end_tick) break;
+        game_tick(game);
+        if(canvas) draw_game(canvas, game, draw);
+    }
+    return pos == replay->count && game_state_hash(game) == replay->final_hash;
+}
+
+/**
+ * @brief Writes a finished replay to storage in a little-endian binary format.
+ * @param replay The replay to save.
+ * @param path The file path to write.
+ * @return True on success, false otherwise.
+ */
+bool replay_save(const Replay* replay, const char* path) {
+    uint8_t header[REPLAY_HEADER_SIZE] = {0};
+    put_u32(header, REPLAY_MAGIC);
+    put_u16(header + 4, REPLAY_VERSION);
+    put_u16(header + 6, replay->flags);
+    put_u16(header + 8, GRID_WIDTH);
+    put_u16(header + 10, GRID_HEIGHT);
+    put_u16(header + 12, MAX_ENEMIES);
+    put_u16(header + 14, MAX_PROJECTILES);
+    put_u32(header + 16, replay->initial_hash);
+    put_u32(header + 20, replay->end_tick);
+    put_u32(header + 24, replay->final_hash);
+    put_u32(header + 28, replay->count);
+
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    bool ok = storage_file_open(file, path, FSAM_WRITE, FSOM_CREATE_ALWAYS) &&
+              storage_file_write(file, header, sizeof(header)) == sizeof(header);
+    uint8_t chunk[REPLAY_IO_CHUNK * sizeof(uint16_t)];
+    for(size_t i = 0; ok && i < replay->count; i += REPLAY_IO_CHUNK) {
+        size_t n = replay->count - i < REPLAY_IO_CHUNK ? replay->count - i : REPLAY_IO_CHUNK;
+        for(size_t j = 0; j < n; j++) {
+            put_u16(chunk + j * 2, replay->events[i + j]);
+        }
+        ok = storage_file_write(file, chunk, n * 2) == n * 2;
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    return ok;
+}
+
+/**
+ * @brief Reads a replay saved by replay_save() from storage.
+ * @param replay The replay to load into. Its capacity must fit the stored events.
+ * @param path The file path to read.
+ * @return True on success, false if the file is missing, malformed or from another build.
+ */
+bool replay_load(Replay* replay, const char* path) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    uint8_t header[REPLAY_HEADER_SIZE];
+    bool ok = storage_file_open(file, path, FSAM_READ, FSOM_OPEN_EXISTING) &&
+              storage_file_read(file, header, sizeof(header)) == sizeof(header) &&
+              get_u32(header) == REPLAY_MAGIC && get_u16(header + 4) == REPLAY_VERSION &&
+              get_u16(header + 8) == GRID_WIDTH && get_u16(header + 10) == GRID_HEIGHT &&
+              get_u16(header + 12) == MAX_ENEMIES &&
+              get_u16(header + 14) == MAX_PROJECTILES &&
+              get_u32(header + 28) <= replay->capacity;
+    if(ok) {
+        replay->flags = get_u16(header + 6);
+        replay->initial_hash = get_u32(header + 16);
+        replay->end_tick = get_u32(header + 20);
+        replay->final_hash = get_u32(header + 24);
+        replay->count = get_u32(header + 28);
+        replay->finished = true;
+    }
+    uint8_t chunk[REPLAY_IO_CHUNK * sizeof(uint16_t)];
+    for(size_t i = 0; ok && i < replay->count; i += REPLAY_IO_CHUNK) {
+        size_t n = replay->count - i < REPLAY_IO_CHUNK ? replay->count - i : REPLAY_IO_CHUNK;
+        ok = storage_file_read(file, chunk, n * 2) == n * 2;
+        for(size_t j = 0; ok && j < n; j++) {
+            replay->events[i + j] = get_u16(chunk + j * 2);
+        }
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+    if(!ok) replay->count = 0;
+    return ok;
+}
@@ -0,0 +1,382 @@
+#include "flipper_td.h"
+
+#include <storage/storage.h>
+#include <string.h>
+
+#define SNAPSHOT_MAGIC       0x53445446 // "FTDS"
+#define SNAPSHOT_VERSION     1
+#define SNAPSHOT_HEADER_SIZE 24
+#define SNAPSHOT_STATE_SIZE  48 // Counters, cursor and view
+#define SNAPSHOT_ENEMY_SIZE  19
+#define SNAPSHOT_SHOT_SIZE   35
+// Largest payload: every slot either live or on the free ring
+#define SNAPSHOT_MAX_PAYLOAD                                                            \
+    (SNAPSHOT_STATE_SIZE + sizeof(((GameState*)0)->grid) + MAX_ENEMIES * 2 + 4 +        \
+     MAX_ENEMIES * (SNAPSHOT_ENEMY_SIZE + 2) + MAX_PROJECTILES * (SNAPSHOT_SHOT_SIZE + 2))
+
+// Bounds-checked cursor over a snapshot payload. Any overrun clears ok and turns further
+// accesses into no-ops, so encoders and decoders only check once at the end.
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t pos;
+    bool ok;
+} SnapshotCursor;
+
+/**
+ * @brief Reserves the next bytes of the payload.
+ * @param cursor The cursor to advance.
+ * @param size The number of bytes needed.
+ * @return Pointer to the bytes, or NULL if they would overrun the payload.
+ */
+static uint8_t* snapshot_take(SnapshotCursor* cursor, size_t size) {
+    if(!cursor->ok || cursor->size - cursor->pos < size) {
+        cursor->ok = false;
+        return NULL;
+    }
+    uint8_t* out = cursor->data + cursor->pos;
+    cursor->pos += size;
+    return out;
+}
+
+static void write_u16(SnapshotCursor* cursor, uint16_t value) {
+    uint8_t* out = snapshot_take(cursor, 2);
+    if(out) put_u16(out, value);
+}
+
+static void write_u32(SnapshotCursor* cursor, uint32_t value) {
+    uint8_t* out = snapshot_take(cursor, 4);
+    if(out) put_u32(out, value);
+}
+
+static void write_scalar(SnapshotCursor* cursor, Scalar value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    write_u32(cursor, bits);
+}
+
+static uint16_t read_u16(SnapshotCursor* cursor) {
+    const uint8_t* in = snapshot_take(cursor, 2);
+    return in ? get_u16(in) : 0;
+}
+
+static uint32_t read_u32(SnapshotCursor* cursor) {
+    const uint8_t* in = snapshot_take(cursor, 4);
+    return in ? get_u32(in) : 0;
+}
+
+static Scalar read_scalar(SnapshotCursor* cursor) {
+    uint32_t bits = read_u32(cursor);
+    Scalar value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Computes the CRC-32 (IEEE 802.3) of a block of bytes.
+ * @param data The bytes to check.
+ * @param size The number of bytes.
+ * @return The checksum.
+ */
+static uint32_t snapshot_crc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for(size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for(int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Writes a slot pool's free ring, oldest entry first. The live slots are implied by
+ * the records written for them.
+ * @param cursor The payload cursor.
+ * @param pool The pool to write.
+ */
+static void write_free_ring(SnapshotCursor* cursor, const SlotPool* pool) {
+    for(int i = 0; i < pool->free_count; i++) {
+        write_u16(cursor, pool->free[(pool->free_head + i) % pool->capacity]);
+    }
+}
+
+/**
+ * @brief Reads a slot pool written as live slot records plus write_free_ring().
+ *
+ * The live bits must already be set. Every slot has to appear exactly once, either live or on
+ * the ring, for the pool to be accepted.
+ * @param cursor The payload cursor.
+ * @param pool The pool to fill in.
+ * @return True if the ring is consistent with the live slots.
+ */
+static bool read_free_ring(SnapshotCursor* cursor, SlotPool* pool) {
+    uint32_t seen[SLOT_MASK_WORDS];
+    memcpy(seen, pool->live, sizeof(seen));
+    pool->free_head = 0;
+    pool->free_count = pool->capacity - pool->live_count;
+    for(int i = 0; i < pool->free_count; i++) {
+        uint16_t slot = read_u16(cursor);
+        if(slot >= pool->capacity || (seen[slot / 32] & (1u << (slot % 32)))) return false;
+        seen[slot / 32] |= 1u << (slot % 32);
+        pool->free[i] = slot;
+    }
+    return cursor->ok;
+}
+
+/**
+ * @brief Encodes the simulation state into a payload. Caches, render state and the profiler
+ * are left out since they are rebuilt on load.
+ * @param game Pointer to the game state.
+ * @param cursor The payload cursor.
+ */
+static void snapshot_encode(const GameState* game, SnapshotCursor* cursor) {
+    write_u32(cursor, game->tick);
+    write_u32(cursor, game->lives);
+    write_u32(cursor, game->gold);
+    write_u32(cursor, game->wave);
+    write_u32(cursor, game->pre_wave_timer);
+    write_u32(cursor, game->wave_spawn_timer);
+    write_u32(cursor, game->wave_spawn_index);
+    write_u32(cursor, game->projectiles_dropped);
+    write_u32(cursor, game->cursor.x);
+    write_u32(cursor, game->cursor.y);
+    write_u32(cursor, game->view.x);
+    write_u32(cursor, game->view.y);
+    uint8_t* grid = snapshot_take(cursor, sizeof(game->grid));
+    if(grid) memcpy(grid, game->grid, sizeof(game->grid));
+
+    // Serials of free slots still decide whether a projectile in flight hits after a respawn
+    const EnemyPool* enemies = &game->enemies;
+    for(int i = 0; i < MAX_ENEMIES; i++) {
+        write_u16(cursor, enemies->serial[i]);
+    }
+    write_u16(cursor, enemies->slots.live_count);
+    for(int i = 0; i < MAX_ENEMIES; i++) {
+        if(!slot_pool_is_live(&enemies->slots, i)) continue;
+        write_u16(cursor, i);
+        write_u16(cursor, enemies->pos[i].x);
+        write_u16(cursor, enemies->pos[i].y);
+        write_scalar(cursor, enemies->progress[i]);
+        write_u32(cursor, enemies->freeze_timer[i]);
+        write_u32(cursor, enemies->hp[i]);
+        uint8_t* spawn = snapshot_take(cursor, 1);
+        if(spawn) *spawn = enemies->spawn[i];
+    }
+    write_free_ring(cursor, &enemies->slots);
+
+    const ProjectilePool* projectiles = &game->projectiles;
+    write_u16(cursor, projectiles->slots.live_count);
+    for(int p = 0; p < MAX_PROJECTILES; p++) {
+        if(!slot_pool_is_live(&projectiles->slots, p)) continue;
+        write_u16(cursor, p);
+        write_scalar(cursor, projectiles->x[p]);
+        write_scalar(cursor, projectiles->y[p]);
+        write_scalar(cursor, projectiles->vx[p]);
+        write_scalar(cursor, projectiles->vy[p]);
+        write_u32(cursor, projectiles->spawn_tick[p]);
+        write_u32(cursor, projectiles->impact_tick[p]);
+        write_u16(cursor, projectiles->target[p]);
+        write_u16(cursor, projectiles->target_serial[p]);
+        write_u32(cursor, projectiles->damage[p]);
+        uint8_t* type = snapshot_take(cursor, 1);
+        if(type) *type = projectiles->tower_type[p];
+    }
+    write_free_ring(cursor, &projectiles->slots);
+}
+
+/**
+ * @brief Decodes a payload written by snapshot_encode() on top of a freshly initialized game,
+ * rejecting anything that could index out of bounds.
+ * @param game Pointer to the game state, as left by init_game_state().
+ * @param cursor The payload cursor.
+ * @return True if the whole payload was consumed and valid.
+ */
+static bool snapshot_decode(GameState* game, SnapshotCursor* cursor) {
+    game->tick = read_u32(cursor);
+    game->lives = (int32_t)read_u32(cursor);
+    game->gold = (int32_t)read_u32(cursor);
+    game->wave = (int32_t)read_u32(cursor);
+    game->pre_wave_timer = (int32_t)read_u32(cursor);
+    game->wave_spawn_timer = (int32_t)read_u32(cursor);
+    game->wave_spawn_index = (int32_t)read_u32(cursor);
+    game->projectiles_dropped = read_u32(cursor);
+    game->cursor.x = (int32_t)read_u32(cursor);
+    game->cursor.y = (int32_t)read_u32(cursor);
+    game->view.x = (int32_t)read_u32(cursor);
+    game->view.y = (int32_t)read_u32(cursor);
+    if(game->cursor.x < 0 || game->cursor.x >= GRID_WIDTH || game->cursor.y < 0 ||
+       game->cursor.y >= GRID_HEIGHT || game->view.x < 0 ||
+       game->view.x > GRID_WIDTH - VIEW_WIDTH || game->view.y < 0 ||
+       game->view.y > GRID_HEIGHT - VIEW_HEIGHT || game->wave < 1) {
+        return false;
+    }
+    const uint8_t* grid = snapshot_take(cursor, sizeof(game->grid));
+    if(!grid) return false;
+    memcpy(game->grid, grid, sizeof(game->grid));
+    for(int cell = 0; cell < GRID_CELLS; cell++) {
+        uint8_t packed = game->grid[cell / 2] >> ((cell % 2) * 4);
+        if((packed & CELL_TYPE_MASK) > TOWER_FREEZE) return false;
+    }
+
+    EnemyPool* enemies = &game->enemies;
+    for(int i = 0; i < MAX_ENEMIES; i++) {
+        enemies->serial[i] = read_u16(cursor);
+    }
+    SlotPool* slots = &enemies->slots;
+    memset(slots->live, 0, sizeof(slots->live));
+    slots->live_count = read_u16(cursor);
+    if(slots->live_count > slots->capacity) return false;
+    for(int n = 0; n < slots->live_count; n++) {
+        uint16_t i = read_u16(cursor);
+        if(i >= MAX_ENEMIES || slot_pool_is_live(slots, i)) return false;
+        slots->live[i / 32] |= 1u << (i % 32);
+        enemies->pos[i].x = (int16_t)read_u16(cursor);
+        enemies->pos[i].y = (int16_t)read_u16(cursor);
+        enemies->progress[i] = read_scalar(cursor);
+        enemies->freeze_timer[i] = (int32_t)read_u32(cursor);
+        enemies->hp[i] = (int32_t)read_u32(cursor);
+        const uint8_t* spawn = snapshot_take(cursor, 1);
+        if(!spawn || *spawn >= game->map->spawn_count) return false;
+        enemies->spawn[i] = *spawn;
+        if(enemies->pos[i].x < 0 || enemies->pos[i].x >= GRID_WIDTH || enemies->pos[i].y < 0 ||
+           enemies->pos[i].y >= GRID_HEIGHT) {
+            return false;
+        }
+    }
+    if(!read_free_ring(cursor, slots)) return false;
+
+    ProjectilePool* projectiles = &game->projectiles;
+    slots = &projectiles->slots;
+    memset(slots->live, 0, sizeof(slots->live));
+    slots->live_count = read_u16(cursor);
+    if(slots->live_count > slots->capacity) return false;
+    for(int n = 0; n < slots->live_count; n++) {
+        uint16_t p = read_u16(cursor);
+        if(p >= MAX_PROJECTILES || slot_pool_is_live(slots, p)) return false;
+        slots->live[p / 32] |= 1u << (p % 32);
+        projectiles->x[p] = read_scalar(cursor);
+        projectiles->y[p] = read_scalar(cursor);
+        projectiles->vx[p] = read_scalar(cursor);
+        projectiles->vy[p] = read_scalar(cursor);
+        projectiles->spawn_tick[p] = read_u32(cursor);
+        projectiles->impact_tick[p] = read_u32(cursor);
+        projectiles->target[p] = (int16_t)read_u16(cursor);
+        projectiles->target_serial[p] = read_u16(cursor);
+        projectiles->damage[p] = (int32_t)read_u32(cursor);
+        const uint8_t* type = snapshot_take(cursor, 1);
+        if(!type) return false;
+        projectiles->tower_type[p] = *type;
+        // Live projectiles always land within the impact wheel's horizon
+        uint32_t flight = projectiles->impact_tick[p] - game->tick;
+        if(flight < 1 || flight >= PROJECTILE_MAX_FLIGHT_TICKS ||
+           projectiles->target[p] < 0 || projectiles->target[p] >= MAX_ENEMIES ||
+           projectiles->tower_type[p] > TOWER_FREEZE) {
+            return false;
+        }
+        projectiles->due[projectiles->impact_tick[p] % PROJECTILE_MAX_FLIGHT_TICKS][p / 32] |=
+            1u << (p % 32);
+    }
+    if(!read_free_ring(cursor, slots)) return false;
+    return cursor->ok && cursor->pos == cursor->size;
+}
+
+/**
+ * @brief Writes a compact binary snapshot of the game to storage.
+ *
+ * Only live enemies and projectiles are stored, and the grid is stored packed, so a typical
+ * snapshot is a few hundred bytes. The payload is checksummed with CRC-32.
+ * @param game Pointer to the game state.
+ * @param path The file path to write.
+ * @return True on success, false otherwise.
+ */
+bool snapshot_save(const GameState* game, const char* path) {
+    uint8_t* buffer = malloc(SNAPSHOT_HEADER_SIZE + SNAPSHOT_MAX_PAYLOAD);
+    if(!buffer) return false;
+    SnapshotCursor cursor = {
+        .data = buffer + SNAPSHOT_HEADER_SIZE, .size = SNAPSHOT_MAX_PAYLOAD, .ok = true};
+    snapshot_encode(game, &cursor);
+    bool ok = cursor.ok;
+
+    put_u32(buffer, SNAPSHOT_MAGIC);
+    put_u16(buffer + 4, SNAPSHOT_VERSION);
+    put_u16(buffer + 6, build_flags());
+    put_u16(buffer + 8, GRID_WIDTH);
+    put_u16(buffer + 10, GRID_HEIGHT);
+    put_u16(buffer + 12, MAX_ENEMIES);
+    put_u16(buffer + 14, MAX_PROJECTILES);
+    put_u32(buffer + 16, cursor.pos);
+    put_u32(buffer + 20, snapshot_crc32(cursor.data, cursor.pos));
+
+    if(ok) {
+        size_t size = SNAPSHOT_HEADER_SIZE + cursor.pos;
+        Storage* storage = furi_record_open(RECORD_STORAGE);
+        File* file = storage_file_alloc(storage);
+        ok = storage_file_open(file, path, FSAM_WRITE, FSOM_CREATE_ALWAYS) &&
+             storage_file_write(file, buffer, size) == size;
+        storage_file_close(file);
+        storage_file_free(file);
+        furi_record_close(RECORD_STORAGE);
+    }
+    free(buffer);
+    return ok;
+}
+
+/**
+ * @brief Restores a game from a snapshot written by snapshot_save().
+ *
+ * The caches are invalidated rather than stored, so the first tick after a load rebuilds
+ * them from the restored grid.
+ * @param game Pointer to the game state to restore into.
+ * @param path The file path to read.
+ * @return True on success. On failure, including a missing, corrupt or foreign file, the game
+ * is left freshly initialized.
+ */
+bool snapshot_load(GameState* game, const char* path) {
+    init_game_state(game);
+    uint8_t* buffer = malloc(SNAPSHOT_HEADER_SIZE + SNAPSHOT_MAX_PAYLOAD);
+    if(!buffer) return false;
+
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    File* file = storage_file_alloc(storage);
+    bool ok = storage_file_open(file, path, FSAM_READ, FSOM_OPEN_EXISTING) &&
+              storage_file_read(file, buffer, SNAPSHOT_HEADER_SIZE) == SNAPSHOT_HEADER_SIZE &&
+              get_u32(buffer) == SNAPSHOT_MAGIC && get_u16(buffer + 4) == SNAPSHOT_VERSION &&
+              get_u16(buffer + 6) == build_flags() &&
+              get_u16(buffer + 8) == GRID_WIDTH && get_u16(buffer + 10) == GRID_HEIGHT &&
+              get_u16(buffer + 12) == MAX_ENEMIES &&
+              get_u16(buffer + 14) == MAX_PROJECTILES &&
+              get_u32(buffer + 16) <= SNAPSHOT_MAX_PAYLOAD;
+    SnapshotCursor cursor = {
+        .data = buffer + SNAPSHOT_HEADER_SIZE, .size = ok ? get_u32(buffer + 16) : 0, .ok = ok};
+    ok = ok && storage_file_read(file, cursor.data, cursor.size) == cursor.size &&
+         snapshot_crc32(cursor.data, cursor.size) == get_u32(buffer + 20);
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_record_close(RECORD_STORAGE);
+
+    if(ok) {
+        memset(game->projectiles.due, 0, sizeof(game->projectiles.due));
+        ok = snapshot_decode(game, &cursor);
+    }
+    free(buffer);
+    if(!ok) {
+        init_game_state(game);
+        return false;
+    }
+    game->grid_generation++;
+    enemy_index_rebuild(game);
+    return true;
+}
+
+/**
+ * @brief Deletes a saved snapshot, so the next launch starts a new game.
+ * @param path The file path to remove.
+ * @return True if the file was removed or did not exist.
+ */
+bool snapshot_remove(const char* path) {
+    Storage* storage = furi_record_open(RECORD_STORAGE);
+    bool ok = storage_simply_remove(storage, path);
+    furi_record_close(RECORD_STORAGE);
+    return ok;
+}
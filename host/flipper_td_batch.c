@@ -0,0 +1,533 @@
+/*
+ * Batch runner for balancing: plays many headless games in parallel and
+ * reports how each tower layout fares over a range of waves.
+ *
+ * Layouts are read from a text file, one block of GRID_HEIGHT rows of
+ * GRID_WIDTH characters per layout, '.' for a free cell and N, R, S or F for
+ * a tower. A "# name" line before a block names it, other lines starting
+ * with '#' and blank lines are ignored. Random legal layouts can be added
+ * with -g. Every layout is played once per wave range, with no player input:
+ *
+ *   ./host/flipper_td_batch -l layouts.txt -w 1-20 -w 10-30 > results.csv
+ *   ./host/flipper_td_batch -g 5000 -d 15 -w 1-40 -D random.txt > results.csv
+ *
+ * Games are independent and deterministic, so the CSV does not depend on the
+ * number of threads. Each worker owns a GameState and a slice of the games,
+ * and steals half of another worker's remaining slice when its own runs out.
+ */
+#include "host.h"
+#include "../flipper_td.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define BATCH_MAX_RANGES    16
+#define BATCH_MAX_THREADS   256
+#define BATCH_NAME_SIZE     32
+#define BATCH_LINE_SIZE     256
+#define BATCH_DEFAULT_TICKS 2000000
+
+static const char batch_tower_chars[] = {
+    [TOWER_NONE] = '.',
+    [TOWER_NORMAL] = 'N',
+    [TOWER_RANGE] = 'R',
+    [TOWER_SPLASH] = 'S',
+    [TOWER_FREEZE] = 'F',
+};
+
+// One tower layout, in map rows
+typedef struct {
+    char name[BATCH_NAME_SIZE];
+    uint8_t tower[GRID_HEIGHT][GRID_WIDTH];
+} BatchLayout;
+
+// Inclusive range of waves a game starts and ends at
+typedef struct {
+    int first;
+    int last;
+} WaveRange;
+
+// Outcome of one game
+typedef struct {
+    bool valid; // False if the layout cut a spawn off or built on a spawn or exit
+    int waves_survived;
+    int lives_lost;
+    uint32_t ticks;
+    int* gold; // Gold after each wave of the range, waves_survived entries
+} BatchResult;
+
+// A worker's slice of the job list: the owner pops from next, thieves take from end
+typedef struct {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+} WorkQueue;
+
+typedef struct {
+    const BatchLayout* layouts;
+    const WaveRange* ranges;
+    int range_count;
+    uint32_t max_ticks;
+    BatchResult* results;
+    WorkQueue* queues;
+    int worker_count;
+} Batch;
+
+typedef struct {
+    Batch* batch;
+    int id;
+    uint64_t ticks;
+    size_t steals;
+} Worker;
+
+/**
+ * @brief Maps a layout character to a tower type.
+ * @param c The character.
+ * @return The tower type, or -1 if c is not a layout character.
+ */
+static int batch_tower_from_char(char c) {
+    for(size_t t = 0; t < sizeof(batch_tower_chars); t++) {
+        if(batch_tower_chars[t] == c) return t;
+    }
+    return -1;
+}
+
+/**
+ * @brief Reads layouts from a text file, appending them to a growing array.
+ * @param path The file to read.
+ * @param layouts Pointer to the array, reallocated as layouts are added.
+ * @param count Pointer to the number of layouts in the array.
+ * @return True on success, false if the file is missing or malformed.
+ */
+static bool batch_read_layouts(const char* path, BatchLayout** layouts, size_t* count) {
+    FILE* file = fopen(path, "r");
+    if(!file) return false;
+    char line[BATCH_LINE_SIZE];
+    char name[BATCH_NAME_SIZE] = "";
+    int row = 0;
+    int line_number = 0;
+    bool ok = true;
+    BatchLayout* layout = NULL;
+    while(ok && fgets(line, sizeof(line), file)) {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '#') {
+            if(line[1] == ' ' && row == 0) {
+                snprintf(name, sizeof(name), "%.*s", (int)sizeof(name) - 1, line + 2);
+            }
+            continue;
+        }
+        if(line[0] == '\0') {
+            if(row != 0) ok = false;
+            continue;
+        }
+        if(row == 0) {
+            BatchLayout* grown = realloc(*layouts, (*count + 1) * sizeof(BatchLayout));
+            if(!grown) {
+                ok = false;
+                break;
+            }
+            *layouts = grown;
+            layout = &grown[*count];
+            if(name[0]) {
+                snprintf(layout->name, sizeof(layout->name), "%s", name);
+            } else {
+                snprintf(layout->name, sizeof(layout->name), "%s:%d", path, line_number);
+            }
+            name[0] = '\0';
+        }
+        if(strlen(line) != GRID_WIDTH) ok = false;
+        for(int x = 0; ok && x < GRID_WIDTH; x++) {
+            int tower = batch_tower_from_char(line[x]);
+            if(tower < 0) ok = false;
+            layout->tower[row][x] = tower;
+        }
+        if(ok && ++row == GRID_HEIGHT) {
+            row = 0;
+            (*count)++;
+        }
+    }
+    fclose(file);
+    if(ok && row != 0) ok = false;
+    if(!ok) {
+        fprintf(
+            stderr,
+            "%s:%d: expected %d rows of %d cells\n",
+            path,
+            line_number,
+            GRID_HEIGHT,
+            GRID_WIDTH);
+    }
+    return ok;
+}
+
+/**
+ * @brief Writes layouts in the format batch_read_layouts() reads.
+ * @param path The file to write.
+ * @param layouts The layouts.
+ * @param count The number of layouts.
+ * @return True on success.
+ */
+static bool batch_write_layouts(const char* path, const BatchLayout* layouts, size_t count) {
+    FILE* file = fopen(path, "w");
+    if(!file) return false;
+    for(size_t i = 0; i < count; i++) {
+        fprintf(file, "# %s\n", layouts[i].name);
+        for(int y = 0; y < GRID_HEIGHT; y++) {
+            for(int x = 0; x < GRID_WIDTH; x++) {
+                fputc(batch_tower_chars[layouts[i].tower[y][x]], file);
+            }
+            fputc('\n', file);
+        }
+        fputc('\n', file);
+    }
+    return fclose(file) == 0;
+}
+
+/**
+ * @brief Builds a random layout by placing towers on legal cells until a density is reached.
+ * @param game Scratch game state used to check placements.
+ * @param rng Pointer to the generator state.
+ * @param density Percentage of cells to fill with towers.
+ * @param layout The layout to fill in.
+ */
+static void batch_random_layout(GameState* game, uint32_t* rng, int density, BatchLayout* layout) {
+    init_game_state(game);
+    for(int x = 0; x < GRID_WIDTH; x++) {
+        for(int y = 0; y < GRID_HEIGHT; y++) {
+            set_grid_cell(game, x, y, TOWER_NONE);
+        }
+    }
+    host_random_towers(game, rng, density);
+    for(int x = 0; x < GRID_WIDTH; x++) {
+        for(int y = 0; y < GRID_HEIGHT; y++) {
+            layout->tower[y][x] = get_grid_cell(game, x, y);
+        }
+    }
+}
+
+/**
+ * @brief Starts a game on a layout at the first wave of a range.
+ * @param game The game state to initialize.
+ * @param layout The towers to build. The starting towers are removed first.
+ * @param first The wave to start at.
+ * @return False if the layout covers a spawn or exit or cuts a spawn off from every exit.
+ */
+static bool batch_start_game(GameState* game, const BatchLayout* layout, int first) {
+    init_game_state(game);
+    for(int x = 0; x < GRID_WIDTH; x++) {
+        for(int y = 0; y < GRID_HEIGHT; y++) {
+            set_grid_cell(game, x, y, layout->tower[y][x]);
+        }
+    }
+    flow_field_update(game);
+    for(int s = 0; s < game->map->spawn_count; s++) {
+        Coord spawn = game->map->spawns[s];
+        if(get_grid_cell(game, spawn.x, spawn.y) != TOWER_NONE) return false;
+        if(game->flow.dist[spawn.x * GRID_HEIGHT + spawn.y] == FLOW_UNREACHABLE) return false;
+    }
+    for(int e = 0; e < game->map->exit_count; e++) {
+        Coord exit = game->map->exits[e];
+        if(get_grid_cell(game, exit.x, exit.y) != TOWER_NONE) return false;
+    }
+    game->wave = first;
+    spawn_wave(game);
+    return true;
+}
+
+/**
+ * @brief Plays one game until the range is cleared, lives run out or the tick budget is spent.
+ * @param game The worker's game state.
+ * @param batch The batch the job belongs to.
+ * @param job The job index: layout job / range_count, range job % range_count.
+ * @return The number of ticks played.
+ */
+static uint32_t batch_run_job(GameState* game, const Batch* batch, size_t job) {
+    const BatchLayout* layout = &batch->layouts[job / batch->range_count];
+    WaveRange range = batch->ranges[job % batch->range_count];
+    BatchResult* result = &batch->results[job];
+    result->valid = batch_start_game(game, layout, range.first);
+    if(!result->valid) return 0;
+
+    int start_lives = game->lives;
+    uint32_t start_tick = game->tick;
+    result->waves_survived = 0;
+    while(game->wave <= range.last && game->lives > 0 &&
+          game->tick - start_tick < batch->max_ticks) {
+        int wave = game->wave;
+        game_tick(game);
+        // A wave only counts as survived if it was cleared with lives left
+        if(game->wave != wave && game->lives > 0) {
+            result->gold[result->waves_survived++] = game->gold;
+        }
+    }
+    result->lives_lost = start_lives - game->lives;
+    result->ticks = game->tick - start_tick;
+    return result->ticks;
+}
+
+/**
+ * @brief Takes the next job from a worker's own queue, or steals half of another's.
+ * @param worker The worker looking for work.
+ * @param job Set to the job index on success.
+ * @return False once every queue is empty.
+ */
+static bool batch_next_job(Worker* worker, size_t* job) {
+    Batch* batch = worker->batch;
+    WorkQueue* own = &batch->queues[worker->id];
+    pthread_mutex_lock(&own->lock);
+    bool found = own->next < own->end;
+    if(found) *job = own->next++;
+    pthread_mutex_unlock(&own->lock);
+    if(found) return true;
+
+    for(int i = 1; i < batch->worker_count; i++) {
+        WorkQueue* victim = &batch->queues[(worker->id + i) % batch->worker_count];
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->end - victim->next;
+        size_t take = (left + 1) / 2;
+        size_t end = victim->end;
+        victim->end -= take;
+        pthread_mutex_unlock(&victim->lock);
+        if(take == 0) continue;
+
+        worker->steals++;
+        *job = end - take;
+        pthread_mutex_lock(&own->lock);
+        own->next = end - take + 1;
+        own->end = end;
+        pthread_mutex_unlock(&own->lock);
+        return true;
+    }
+    return false;
+}
+
+static void* batch_worker(void* context) {
+    Worker* worker = context;
+    GameState* game = malloc(sizeof(GameState));
+    if(!game) return NULL;
+    size_t job;
+    while(batch_next_job(worker, &job)) {
+        worker->ticks += batch_run_job(game, worker->batch, job);
+    }
+    free(game);
+    return NULL;
+}
+
+/**
+ * @brief Parses a wave range written as "first-last" or a single wave.
+ * @param text The text to parse.
+ * @param range The range to fill in.
+ * @return True if the range is valid.
+ */
+static bool batch_parse_range(const char* text, WaveRange* range) {
+    char* end;
+    range->first = strtol(text, &end, 10);
+    range->last = *end == '-' ? strtol(end + 1, &end, 10) : range->first;
+    return *end == '\0' && range->first >= 1 && range->last >= range->first;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-l file]... [-g count] [-d pct] [-s seed] -w range...\n", name);
+    fprintf(stderr, "       [-j threads] [-T ticks] [-D file] [-o file]\n");
+    fprintf(stderr, "  -l file   read tower layouts from a file, may be repeated\n");
+    fprintf(stderr, "  -g count  add count random legal layouts\n");
+    fprintf(stderr, "  -d pct    percentage of cells with towers when generating (default 10)\n");
+    fprintf(stderr, "  -s seed   seed for random layouts (default 1)\n");
+    fprintf(stderr, "  -w range  waves to play, e.g. 1-20, up to %d ranges\n", BATCH_MAX_RANGES);
+    fprintf(stderr, "  -j n      worker threads (default: one per core)\n");
+    fprintf(stderr, "  -T ticks  tick budget per game (default %d)\n", BATCH_DEFAULT_TICKS);
+    fprintf(stderr, "  -D file   also write the layouts to a file, e.g. to keep generated ones\n");
+    fprintf(stderr, "  -o file   write the CSV results to a file instead of stdout\n");
+}
+
+int main(int argc, char** argv) {
+    BatchLayout* layouts = NULL;
+    size_t layout_count = 0;
+    WaveRange ranges[BATCH_MAX_RANGES];
+    int range_count = 0;
+    int generate = 0;
+    int density = 10;
+    uint32_t seed = 1;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t max_ticks = BATCH_DEFAULT_TICKS;
+    const char* dump_path = NULL;
+    const char* output_path = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "l:g:d:s:w:j:T:D:o:h")) != -1) {
+        switch(opt) {
+        case 'l':
+            if(!batch_read_layouts(optarg, &layouts, &layout_count)) {
+                fprintf(stderr, "cannot read layouts from %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'g':
+            generate = atoi(optarg);
+            break;
+        case 'd':
+            density = atoi(optarg);
+            break;
+        case 's':
+            seed = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            if(range_count == BATCH_MAX_RANGES ||
+               !batch_parse_range(optarg, &ranges[range_count])) {
+                fprintf(stderr, "bad wave range %s\n", optarg);
+                return 1;
+            }
+            range_count++;
+            break;
+        case 'j':
+            threads = atol(optarg);
+            break;
+        case 'T':
+            max_ticks = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'D':
+            dump_path = optarg;
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(seed == 0) seed = 1;
+    if(threads < 1) threads = 1;
+    if(threads > BATCH_MAX_THREADS) threads = BATCH_MAX_THREADS;
+    if(range_count == 0 || (layout_count == 0 && generate <= 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(generate > 0) {
+        BatchLayout* grown = realloc(layouts, (layout_count + generate) * sizeof(BatchLayout));
+        GameState* game = malloc(sizeof(GameState));
+        if(!grown || !game) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        layouts = grown;
+        uint32_t rng = seed;
+        for(int i = 0; i < generate; i++) {
+            BatchLayout* layout = &layouts[layout_count++];
+            snprintf(layout->name, sizeof(layout->name), "random-%d", i);
+            batch_random_layout(game, &rng, density, layout);
+        }
+        free(game);
+    }
+    if(dump_path && !batch_write_layouts(dump_path, layouts, layout_count)) {
+        fprintf(stderr, "cannot write layouts to %s\n", dump_path);
+        return 1;
+    }
+
+    // Every allocation happens up front, so the games themselves never allocate
+    size_t job_count = layout_count * range_count;
+    Batch batch = {
+        .layouts = layouts,
+        .ranges = ranges,
+        .range_count = range_count,
+        .max_ticks = max_ticks,
+        .results = calloc(job_count, sizeof(BatchResult)),
+        .queues = calloc(threads, sizeof(WorkQueue)),
+        .worker_count = threads,
+    };
+    Worker* workers = calloc(threads, sizeof(Worker));
+    pthread_t* thread_ids = calloc(threads, sizeof(pthread_t));
+    if(!batch.results || !batch.queues || !workers || !thread_ids) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for(size_t job = 0; job < job_count; job++) {
+        WaveRange range = ranges[job % range_count];
+        batch.results[job].gold = malloc((range.last - range.first + 1) * sizeof(int));
+        if(!batch.results[job].gold) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    for(long i = 0; i < threads; i++) {
+        pthread_mutex_init(&batch.queues[i].lock, NULL);
+        batch.queues[i].next = job_count * i / threads;
+        batch.queues[i].end = job_count * (i + 1) / threads;
+        workers[i] = (Worker){.batch = &batch, .id = i};
+    }
+
+    uint64_t start = host_time_ns();
+    for(long i = 0; i < threads; i++) {
+        if(pthread_create(&thread_ids[i], NULL, batch_worker, &workers[i]) != 0) {
+            fprintf(stderr, "cannot start worker %ld\n", i);
+            return 1;
+        }
+    }
+    uint64_t ticks = 0;
+    size_t steals = 0;
+    for(long i = 0; i < threads; i++) {
+        pthread_join(thread_ids[i], NULL);
+        ticks += workers[i].ticks;
+        steals += workers[i].steals;
+    }
+    double seconds = (host_time_ns() - start) / 1e9;
+
+    FILE* out = output_path ? fopen(output_path, "w") : stdout;
+    if(!out) {
+        fprintf(stderr, "cannot write %s\n", output_path);
+        return 1;
+    }
+    fprintf(out, "layout,first_wave,last_wave,valid,waves_survived,lives_lost,ticks,gold\n");
+    for(size_t job = 0; job < job_count; job++) {
+        const BatchResult* result = &batch.results[job];
+        WaveRange range = ranges[job % range_count];
+        fprintf(
+            out,
+            "%s,%d,%d,%d,",
+            layouts[job / range_count].name,
+            range.first,
+            range.last,
+            result->valid);
+        if(!result->valid) {
+            fprintf(out, ",,,\n");
+            continue;
+        }
+        fprintf(
+            out,
+            "%d,%d,%" PRIu32 ",",
+            result->waves_survived,
+            result->lives_lost,
+            result->ticks);
+        for(int w = 0; w < result->waves_survived; w++) {
+            fprintf(out, w ? " %d" : "%d", result->gold[w]);
+        }
+        fputc('\n', out);
+    }
+    if(out != stdout) fclose(out);
+    fprintf(
+        stderr,
+        "games=%zu threads=%ld steals=%zu seconds=%.3f games_per_second=%.0f "
+        "ticks_per_second=%.0f\n",
+        job_count,
+        threads,
+        steals,
+        seconds,
+        job_count / seconds,
+        ticks / seconds);
+
+    for(size_t job = 0; job < job_count; job++) {
+        free(batch.results[job].gold);
+    }
+    for(long i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&batch.queues[i].lock);
+    }
+    free(thread_ids);
+    free(workers);
+    free(batch.queues);
+    free(batch.results);
+    free(layouts);
+    return 0;
+}
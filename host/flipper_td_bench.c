@@ -0,0 +1,433 @@
+/*
+ * Microbenchmarks for the simulation kernels.
+ *
+ * Each kernel is timed on its own against a fixed game state: the state is
+ * restored from a saved copy before every sample, outside the timed region,
+ * so every call sees the same enemies, projectiles and grid. States are built
+ * for each tower density in the sweep with a full wave of enemies on the map.
+ *
+ *   make -C host flipper_td_bench && ./host/flipper_td_bench -o bench.csv
+ *
+ * Grid and pool sizes are fixed at build time, so `make -C host bench`
+ * rebuilds this file for each configuration in BENCH_GRIDS x BENCH_POOLS and
+ * appends every run to one CSV. A later run can be checked against it:
+ *
+ *   ./host/flipper_td_bench -b bench.csv -x 20   # exit 3 if a median is 20% slower
+ */
+#include "host.h"
+#include "../flipper_td.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+
+#define BENCH_MAX_DENSITIES 16
+#define BENCH_LINE_SIZE     256
+#define BENCH_CSV_HEADER                                                                   \
+    "kernel,fixed_point,map_layout,grid_width,grid_height,max_enemies,max_projectiles,"    \
+    "density,towers,live_enemies,live_projectiles,samples,min_ns,median_ns,mean_ns\n"
+
+#ifdef FLIPPER_TD_FIXED_POINT
+#define BENCH_FIXED_POINT 1
+#else
+#define BENCH_FIXED_POINT 0
+#endif
+
+typedef struct {
+    const char* name;
+    void (*run)(GameState* game, Canvas* canvas);
+} BenchKernel;
+
+// Configuration a result was measured on; rows with equal keys are compared
+typedef struct {
+    char kernel[32];
+    int fixed_point;
+    int map_layout;
+    int grid_width;
+    int grid_height;
+    int max_enemies;
+    int max_projectiles;
+    int density;
+} BenchKey;
+
+typedef struct {
+    BenchKey key;
+    int towers;
+    int live_enemies;
+    int live_projectiles;
+    int samples;
+    uint64_t min_ns;
+    uint64_t median_ns;
+    uint64_t mean_ns;
+} BenchResult;
+
+static Coord bench_path[GRID_CELLS];
+static DrawContext bench_draw;
+
+static void bench_find_path(GameState* game, Canvas* canvas) {
+    UNUSED(canvas);
+    int length;
+    find_path(game, game->map->spawns[0], game->map->exits[0], bench_path, &length);
+}
+
+static void bench_flow_field(GameState* game, Canvas* canvas) {
+    UNUSED(canvas);
+    game->flow.generation = game->grid_generation - 1;
+    flow_field_update(game);
+}
+
+static void bench_placement_index(GameState* game, Canvas* canvas) {
+    UNUSED(canvas);
+    game->placement.generation = game->grid_generation - 1;
+    placement_index_update(game);
+}
+
+static void bench_update_enemies(GameState* game, Canvas* canvas) {
+    UNUSED(canvas);
+    update_enemies(game);
+}
+
+static void bench_update_tower_firing(GameState* game, Canvas* canvas) {
+    UNUSED(canvas);
+    update_tower_firing(game);
+}
+
+static void bench_update_projectiles(GameState* game, Canvas* canvas) {
+    UNUSED(canvas);
+    update_projectiles(game);
+}
+
+static void bench_draw_game(GameState* game, Canvas* canvas) {
+    draw_game(canvas, game, &bench_draw);
+}
+
+static const BenchKernel bench_kernels[] = {
+    {"find_path", bench_find_path},
+    {"flow_field", bench_flow_field},
+    {"placement_index", bench_placement_index},
+    {"update_enemies", bench_update_enemies},
+    {"update_tower_firing", bench_update_tower_firing},
+    {"update_projectiles", bench_update_projectiles},
+    {"draw_game", bench_draw_game},
+};
+
+/**
+ * @brief Builds the state the kernels are timed on: random legal towers at a density, and a
+ * full enemy pool spread over the cells that lead to an exit, with the towers' first shots in
+ * flight.
+ * @param game The game state to build.
+ * @param canvas The canvas, drawn once so the render cache is warm.
+ * @param density Percentage of cells to fill with towers.
+ * @return The number of towers on the map, including the starting ones.
+ */
+static int bench_prepare(GameState* game, Canvas* canvas, int density) {
+    init_game_state(game);
+    uint32_t rng = 1;
+    int towers = host_random_towers(game, &rng, density);
+
+    // Enemies are placed directly, tough enough to outlive the warm-up, and the wave is held
+    // back so no more spawn
+    game->pre_wave_timer = INT32_MAX;
+    flow_field_update(game);
+    for(int i = slot_pool_acquire(&game->enemies.slots); i >= 0;
+        i = slot_pool_acquire(&game->enemies.slots)) {
+        Coord pos;
+        do {
+            pos.x = host_xorshift32(&rng) % GRID_WIDTH;
+            pos.y = host_xorshift32(&rng) % GRID_HEIGHT;
+        } while(get_grid_cell(game, pos.x, pos.y) != TOWER_NONE ||
+                game->flow.dist[pos.x * GRID_HEIGHT + pos.y] == 0 ||
+                game->flow.dist[pos.x * GRID_HEIGHT + pos.y] == FLOW_UNREACHABLE);
+        game->enemies.serial[i]++;
+        game->enemies.pos[i] = pos;
+        game->enemies.hp[i] = 1000000;
+        game->enemies.progress[i] = 0;
+        game->enemies.freeze_timer[i] = 0;
+    }
+    enemy_index_rebuild(game);
+    for(int t = 0; t < 4; t++) {
+        game_tick(game);
+    }
+    draw_context_init(&bench_draw);
+    draw_game(canvas, game, &bench_draw);
+    // Kernels run as in game_tick(), after the tick counter moves on
+    game->tick++;
+    return towers;
+}
+
+/**
+ * @brief qsort() comparator for sample timings.
+ * @param a A uint64_t.
+ * @param b Another uint64_t.
+ * @return Negative, zero or positive as a is less than, equal to or greater than b.
+ */
+static int bench_compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Times one kernel against a saved state.
+ * @param kernel The kernel to time.
+ * @param saved The state every sample starts from.
+ * @param game Working state, overwritten before each sample.
+ * @param canvas The counting canvas.
+ * @param times Buffer for samples timings.
+ * @param samples The number of samples.
+ * @param result The result to fill in the timings of.
+ */
+static void bench_kernel(
+    const BenchKernel* kernel,
+    const GameState* saved,
+    GameState* game,
+    Canvas* canvas,
+    uint64_t* times,
+    int samples,
+    BenchResult* result) {
+    uint64_t total = 0;
+    for(int i = 0; i < samples; i++) {
+        memcpy(game, saved, sizeof(GameState));
+        uint64_t start = host_time_ns();
+        kernel->run(game, canvas);
+        times[i] = host_time_ns() - start;
+        total += times[i];
+    }
+    qsort(times, samples, sizeof(uint64_t), bench_compare_u64);
+    result->samples = samples;
+    result->min_ns = times[0];
+    result->median_ns = times[samples / 2];
+    result->mean_ns = total / samples;
+}
+
+/**
+ * @brief Writes a result as one CSV row in BENCH_CSV_HEADER column order.
+ * @param out The file to write to.
+ * @param result The result to write.
+ */
+static void bench_write_result(FILE* out, const BenchResult* result) {
+    const BenchKey* key = &result->key;
+    fprintf(
+        out,
+        "%s,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+        key->kernel,
+        key->fixed_point,
+        key->map_layout,
+        key->grid_width,
+        key->grid_height,
+        key->max_enemies,
+        key->max_projectiles,
+        key->density,
+        result->towers,
+        result->live_enemies,
+        result->live_projectiles,
+        result->samples,
+        result->min_ns,
+        result->median_ns,
+        result->mean_ns);
+}
+
+/**
+ * @brief Parses one CSV row written by bench_write_result().
+ * @param line The row.
+ * @param result The result to fill in.
+ * @return True if the row is a complete result.
+ */
+static bool bench_parse_result(const char* line, BenchResult* result) {
+    BenchKey* key = &result->key;
+    return sscanf(
+               line,
+               "%31[^,],%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%" SCNu64 ",%" SCNu64 ",%" SCNu64,
+               key->kernel,
+               &key->fixed_point,
+               &key->map_layout,
+               &key->grid_width,
+               &key->grid_height,
+               &key->max_enemies,
+               &key->max_projectiles,
+               &key->density,
+               &result->towers,
+               &result->live_enemies,
+               &result->live_projectiles,
+               &result->samples,
+               &result->min_ns,
+               &result->median_ns,
+               &result->mean_ns) == 15;
+}
+
+/**
+ * @brief Checks whether two results were measured on the same kernel and configuration.
+ * @param a A result key.
+ * @param b Another result key.
+ * @return True if every field of the keys matches.
+ */
+static bool bench_same_key(const BenchKey* a, const BenchKey* b) {
+    return strcmp(a->kernel, b->kernel) == 0 && a->fixed_point == b->fixed_point &&
+           a->map_layout == b->map_layout && a->grid_width == b->grid_width &&
+           a->grid_height == b->grid_height && a->max_enemies == b->max_enemies &&
+           a->max_projectiles == b->max_projectiles && a->density == b->density;
+}
+
+/**
+ * @brief Compares a result against the matching row of a baseline file.
+ * @param baseline The baseline CSV, rewound and scanned for the result's configuration.
+ * @param result The new result.
+ * @param tolerance Allowed slowdown of the median in percent.
+ * @return True if the result regressed by more than the tolerance.
+ */
+static bool bench_regressed(FILE* baseline, const BenchResult* result, int tolerance) {
+    char line[BENCH_LINE_SIZE];
+    BenchResult base = {0};
+    bool found = false;
+    rewind(baseline);
+    // The last matching row wins, so a baseline file can keep being appended to
+    while(fgets(line, sizeof(line), baseline)) {
+        BenchResult row;
+        if(bench_parse_result(line, &row) && bench_same_key(&row.key, &result->key)) {
+            base = row;
+            found = true;
+        }
+    }
+    if(!found || base.median_ns == 0) return false;
+    int64_t change = ((int64_t)result->median_ns - (int64_t)base.median_ns) * 100 /
+                     (int64_t)base.median_ns;
+    if(change <= tolerance) return false;
+    fprintf(
+        stderr,
+        "regression: %s density=%d median %" PRIu64 " ns -> %" PRIu64 " ns (+%" PRId64 "%%)\n",
+        result->key.kernel,
+        result->key.density,
+        base.median_ns,
+        result->median_ns,
+        change);
+    return true;
+}
+
+/**
+ * @brief Parses a comma-separated list of densities.
+ * @param text The list, e.g. "0,10,20".
+ * @param densities The array to fill in.
+ * @return The number of densities, or 0 if the list is malformed.
+ */
+static int bench_parse_densities(const char* text, int* densities) {
+    int count = 0;
+    char* end;
+    do {
+        if(count == BENCH_MAX_DENSITIES) return 0;
+        densities[count] = strtol(text, &end, 10);
+        if(end == text || densities[count] < 0 || densities[count] > 90) return 0;
+        count++;
+        text = end + 1;
+    } while(*end == ',');
+    return *end == '\0' ? count : 0;
+}
+
+/**
+ * @brief Prints the command-line options to stderr.
+ * @param name The program name, argv[0].
+ */
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-d densities] [-n samples] [-o file] [-b file [-x pct]]\n", name);
+    fprintf(stderr, "  -d list   tower densities in percent of cells (default 0,10,20,30)\n");
+    fprintf(stderr, "  -n count  samples per kernel and density (default 1000)\n");
+    fprintf(stderr, "  -o file   append CSV results to a file instead of printing them\n");
+    fprintf(stderr, "  -b file   compare medians against a CSV from an earlier run\n");
+    fprintf(stderr, "  -x pct    slowdown allowed by -b before failing (default 10)\n");
+}
+
+int main(int argc, char** argv) {
+    int densities[BENCH_MAX_DENSITIES] = {0, 10, 20, 30};
+    int density_count = 4;
+    int samples = 1000;
+    int tolerance = 10;
+    const char* output_path = NULL;
+    const char* baseline_path = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "d:n:o:b:x:h")) != -1) {
+        switch(opt) {
+        case 'd':
+            density_count = bench_parse_densities(optarg, densities);
+            if(density_count == 0) {
+                fprintf(stderr, "bad density list %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            samples = atoi(optarg);
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        case 'x':
+            tolerance = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(samples < 1) samples = 1;
+
+    FILE* out = stdout;
+    if(output_path) {
+        out = fopen(output_path, "a");
+        if(!out) {
+            fprintf(stderr, "cannot write %s\n", output_path);
+            return 1;
+        }
+    }
+    FILE* baseline = NULL;
+    if(baseline_path) {
+        baseline = fopen(baseline_path, "r");
+        if(!baseline) {
+            fprintf(stderr, "cannot read %s\n", baseline_path);
+            return 1;
+        }
+    }
+    GameState* saved = malloc(sizeof(GameState));
+    GameState* game = malloc(sizeof(GameState));
+    uint64_t* times = malloc(samples * sizeof(uint64_t));
+    Canvas* canvas = host_canvas_alloc();
+    if(!saved || !game || !times || !canvas) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    // ftell() fails on a pipe, which has no earlier rows to match either
+    if(ftell(out) <= 0) fputs(BENCH_CSV_HEADER, out);
+
+    int regressions = 0;
+    for(int d = 0; d < density_count; d++) {
+        int towers = bench_prepare(saved, canvas, densities[d]);
+        for(size_t k = 0; k < sizeof(bench_kernels) / sizeof(bench_kernels[0]); k++) {
+            BenchResult result = {
+                .key =
+                    {
+                        .fixed_point = BENCH_FIXED_POINT,
+                        .map_layout = MAP_LAYOUT,
+                        .grid_width = GRID_WIDTH,
+                        .grid_height = GRID_HEIGHT,
+                        .max_enemies = MAX_ENEMIES,
+                        .max_projectiles = MAX_PROJECTILES,
+                        .density = densities[d],
+                    },
+                .towers = towers,
+                .live_enemies = saved->enemies.slots.live_count,
+                .live_projectiles = saved->projectiles.slots.live_count,
+            };
+            snprintf(result.key.kernel, sizeof(result.key.kernel), "%s", bench_kernels[k].name);
+            bench_kernel(&bench_kernels[k], saved, game, canvas, times, samples, &result);
+            bench_write_result(out, &result);
+            if(baseline && bench_regressed(baseline, &result, tolerance)) regressions++;
+        }
+    }
+
+    if(out != stdout) fclose(out);
+    if(baseline) fclose(baseline);
+    host_canvas_free(canvas);
+    free(times);
+    free(game);
+    free(saved);
+    return regressions ? 3 : 0;
+}
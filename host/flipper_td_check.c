@@ -0,0 +1,350 @@
+/*
+ * Regression checks for the simulation core.
+ *
+ * Each check builds the game state it needs directly, runs the code under
+ * test and compares the outcome with what the game should do. Failures are
+ * reported one per line and make the exit status non-zero:
+ *
+ *   make -C host check
+ */
+#include "host.h"
+#include "../flipper_td.h"
+
+typedef struct {
+    const char* name;
+    bool (*run)(GameState* game);
+} Check;
+
+/**
+ * @brief Reports a failed condition inside a check.
+ * @param ok The condition.
+ * @param what What was expected, for the report.
+ * @return ok.
+ */
+static bool check_that(bool ok, const char* what) {
+    if(!ok) fprintf(stderr, "  expected %s\n", what);
+    return ok;
+}
+
+/**
+ * @brief Puts an enemy that towers cannot kill on a cell, as if it had walked there.
+ * @param game The game state.
+ * @param pos The enemy's cell.
+ * @return The enemy's slot.
+ */
+static int check_add_enemy(GameState* game, Coord pos) {
+    int e = slot_pool_acquire(&game->enemies.slots);
+    game->enemies.pos[e] = pos;
+    game->enemies.hp[e] = 1000000;
+    game->enemies.progress[e] = 0;
+    game->enemies.freeze_timer[e] = 0;
+    return e;
+}
+
+/**
+ * @brief An enemy walled into a pocket with no way to an exit waits there without holding up
+ * the end of its wave, and walks on once a path opens.
+ * @param game Scratch game state.
+ * @return True if the check passed.
+ */
+static bool check_stranded_enemy(GameState* game) {
+    init_game_state(game);
+    // The last enemy of the wave is already on the map and no more spawn
+    game->pre_wave_timer = 0;
+    game->wave_spawn_index = get_wave_params(game->wave).enemy_count;
+    const Coord pocket = {8, GRID_HEIGHT - 1};
+    check_add_enemy(game, pocket);
+
+    // Every placement is legal on its own, since only the enemy's pocket against the bottom
+    // edge is cut off
+    const int y = GRID_HEIGHT - 3;
+    const Coord ring[] = {
+        {6, y}, {7, y}, {8, y}, {9, y}, {10, y}, {6, y + 1}, {6, y + 2}, {10, y + 1}, {10, y + 2}};
+    bool ok = true;
+    for(size_t i = 0; i < sizeof(ring) / sizeof(ring[0]); i++) {
+        ok &= check_that(!placement_blocks_path(game, ring[i].x, ring[i].y), "legal placement");
+        set_grid_cell(game, ring[i].x, ring[i].y, TOWER_NORMAL);
+    }
+
+    int lives = game->lives;
+    int wave = game->wave;
+    game_tick(game);
+    ok &= check_that(game->wave == wave + 1, "next wave started");
+    ok &= check_that(game->lives == lives, "no life lost");
+
+    // Before the next wave spawns, a stranded enemy stays where it is
+    int e = check_add_enemy(game, pocket);
+    for(int t = 0; t < 20; t++) {
+        game_tick(game);
+    }
+    ok &= check_that(slot_pool_is_live(&game->enemies.slots, e), "stranded enemy still on the map");
+    ok &= check_that(
+        game->enemies.pos[e].x == pocket.x && game->enemies.pos[e].y == pocket.y,
+        "stranded enemy waiting");
+
+    // Selling the tower above it opens a path
+    set_grid_cell(game, 8, y, TOWER_NONE);
+    for(int t = 0; t < 20; t++) {
+        game_tick(game);
+    }
+    ok &= check_that(
+        !slot_pool_is_live(&game->enemies.slots, e) || game->enemies.pos[e].x != pocket.x ||
+            game->enemies.pos[e].y != pocket.y,
+        "enemy walking once a path opens");
+    return ok;
+}
+
+/**
+ * @brief Plays a game with a few towers into its third wave, up to a tick with projectiles in
+ * flight.
+ * @param game The game state to play into. It is reinitialized first.
+ */
+static void check_mid_game(GameState* game) {
+    init_game_state(game);
+    // Enemies walk along the bottom edge, so towers go on the row above it
+    const int y = GRID_HEIGHT - 2;
+    for(int x = 2; x < GRID_WIDTH - 2; x += 3) {
+        if(!placement_blocks_path(game, x, y)) set_grid_cell(game, x, y, TOWER_NORMAL);
+    }
+    for(int t = 0; t < 5000; t++) {
+        game_tick(game);
+        if(game->wave > 2 && game->enemies.slots.live_count > 1 &&
+           game->projectiles.slots.live_count > 0) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief A game saved mid-wave and loaded again has the same state, and keeps playing the
+ * same ticks as the game it was saved from.
+ * @param game Scratch game state.
+ * @return True if the check passed.
+ */
+static bool check_snapshot_round_trip(GameState* game) {
+    const char* path = "flipper_td_check.snapshot";
+    GameState* loaded = malloc(sizeof(GameState));
+    if(!loaded) return check_that(false, "memory for a second game");
+    check_mid_game(game);
+    bool ok = check_that(game->enemies.slots.live_count > 0, "enemies on the map");
+    ok &= check_that(game->projectiles.slots.live_count > 0, "projectiles in flight");
+    ok &= check_that(snapshot_save(game, path), "snapshot saved");
+    ok &= check_that(snapshot_load(loaded, path), "snapshot loaded");
+    ok &= check_that(game_state_hash(loaded) == game_state_hash(game), "same state after load");
+    for(int t = 0; t < 2000; t++) {
+        game_tick(game);
+        game_tick(loaded);
+    }
+    ok &= check_that(game_state_hash(loaded) == game_state_hash(game), "same state 2000 ticks on");
+    remove(path);
+    free(loaded);
+    return ok;
+}
+
+/**
+ * @brief A snapshot with one byte changed is rejected and leaves a new game.
+ * @param game Scratch game state.
+ * @return True if the check passed.
+ */
+static bool check_snapshot_corrupt(GameState* game) {
+    const char* path = "flipper_td_check.snapshot";
+    init_game_state(game);
+    uint32_t fresh = game_state_hash(game);
+    check_mid_game(game);
+    bool ok = check_that(snapshot_save(game, path), "snapshot saved");
+
+    // Flip a bit in the last byte of the payload, which only the CRC covers
+    FILE* file = fopen(path, "r+b");
+    ok &= check_that(file != NULL, "snapshot file to corrupt");
+    if(file) {
+        fseek(file, -1, SEEK_END);
+        int byte = fgetc(file);
+        fseek(file, -1, SEEK_END);
+        fputc(byte ^ 0x01, file);
+        fclose(file);
+    }
+    ok &= check_that(!snapshot_load(game, path), "corrupt snapshot rejected");
+    ok &= check_that(game_state_hash(game) == fresh, "new game after a rejected snapshot");
+    remove(path);
+    return ok;
+}
+
+/**
+ * @brief Returns a random Scalar in [lo, hi) with a fractional part in thousandths.
+ * @param rng Pointer to the generator state.
+ * @param lo The lowest value.
+ * @param hi The bound above the highest value.
+ * @return The value.
+ */
+static Scalar check_random_scalar(uint32_t* rng, int lo, int hi) {
+    int thousandths = host_xorshift32(rng) % ((hi - lo) * 1000);
+    return SCALAR_FROM_RATIO(lo * 1000 + thousandths, 1000);
+}
+
+/**
+ * @brief The batched projectile_dots() gives exactly the pixels of the one-slot-at-a-time
+ * loop the Flipper runs, on random pools, flights and views. In a build without
+ * FLIPPER_TD_VECTOR_KERNELS both are the same loop.
+ * @param game Scratch game state.
+ * @return True if the check passed.
+ */
+static bool check_projectile_dots(GameState* game) {
+    init_game_state(game);
+    ProjectilePool* projectiles = &game->projectiles;
+    uint32_t rng = 1;
+    for(int round = 0; round < 100000; round++) {
+        // Random live slots, including gaps and partly live lanes
+        slot_pool_init(&projectiles->slots, MAX_PROJECTILES);
+        int live = host_xorshift32(&rng) % (MAX_PROJECTILES + 1);
+        for(int p = 0; p < live; p++) {
+            slot_pool_acquire(&projectiles->slots);
+        }
+        for(int p = 0; p < MAX_PROJECTILES; p++) {
+            if(slot_pool_is_live(&projectiles->slots, p) && host_xorshift32(&rng) % 3 == 0) {
+                slot_pool_release(&projectiles->slots, p);
+            }
+        }
+        game->tick = 1000 + host_xorshift32(&rng) % 100000;
+        game->view.x = host_xorshift32(&rng) % (GRID_WIDTH - VIEW_WIDTH + 1);
+        game->view.y = host_xorshift32(&rng) % (GRID_HEIGHT - VIEW_HEIGHT + 1);
+        // Dead slots get values too, since the batches read them
+        for(int p = 0; p < MAX_PROJECTILES; p++) {
+            projectiles->x[p] = check_random_scalar(&rng, -20, GRID_WIDTH * CELL_SIZE + 20);
+            projectiles->y[p] = check_random_scalar(&rng, -20, GRID_HEIGHT * CELL_SIZE + 30);
+            projectiles->vx[p] = check_random_scalar(&rng, -3, 3);
+            projectiles->vy[p] = check_random_scalar(&rng, -3, 3);
+            projectiles->spawn_tick[p] = game->tick - host_xorshift32(&rng) % 33;
+        }
+
+        Coord batched[MAX_PROJECTILES];
+        Coord scalar[MAX_PROJECTILES];
+        int count = projectile_dots(game, batched);
+        if(count != projectile_dots_scalar(game, 0, scalar) ||
+           memcmp(batched, scalar, count * sizeof(Coord)) != 0) {
+            fprintf(stderr, "  round %d: pixels differ\n", round);
+            return false;
+        }
+    }
+    return true;
+}
+
+// The 5x7 tower glyphs the cached background drew before the sprite atlas, copied verbatim from
+// the tower_glyphs[] table it replaced: one byte per row, LSB leftmost
+static const uint8_t check_tower_glyphs[][7] = {
+    [TOWER_NORMAL] = {0x11, 0x11, 0x13, 0x15, 0x19, 0x11, 0x11},
+    [TOWER_RANGE] = {0x0F, 0x11, 0x11, 0x0F, 0x05, 0x09, 0x11},
+    [TOWER_SPLASH] = {0x1E, 0x01, 0x01, 0x0E, 0x10, 0x10, 0x0F},
+    [TOWER_FREEZE] = {0x1F, 0x01, 0x01, 0x0F, 0x01, 0x01, 0x01},
+};
+
+/**
+ * @brief Draws a frame the way render_snapshot_draw() did before the sprite atlas: grid lines,
+ * a 5x7 glyph per tower, a dot per blocking cell and a radius 3 circle per enemy.
+ * @param canvas The canvas to draw on.
+ * @param snapshot The frame to draw.
+ */
+static void check_draw_reference(Canvas* canvas, const RenderSnapshot* snapshot) {
+    canvas_reset(canvas);
+    for(int y = 0; y < BACKGROUND_HEIGHT; y += CELL_SIZE) {
+        canvas_draw_box(canvas, 0, STATUS_BAR_HEIGHT + y, BACKGROUND_WIDTH, 1);
+    }
+    for(int x = 0; x < BACKGROUND_WIDTH; x += CELL_SIZE) {
+        canvas_draw_box(canvas, x, STATUS_BAR_HEIGHT, 1, BACKGROUND_HEIGHT);
+    }
+    for(int cy = 0; cy < VIEW_HEIGHT; cy++) {
+        for(int cx = 0; cx < VIEW_WIDTH; cx++) {
+            int left = cx * CELL_SIZE;
+            int top = STATUS_BAR_HEIGHT + cy * CELL_SIZE;
+            uint8_t packed = snapshot->cells[cy * VIEW_WIDTH + cx];
+            TowerType tower = packed & CELL_TYPE_MASK;
+            if(tower == TOWER_NONE) {
+                if(packed & RENDER_CELL_BLOCKING) {
+                    canvas_draw_dot(canvas, left + CELL_SIZE / 2, top + CELL_SIZE / 2);
+                }
+                continue;
+            }
+            for(int row = 0; row < 7; row++) {
+                for(int col = 0; col < 5; col++) {
+                    if(check_tower_glyphs[tower][row] >> col & 1) {
+                        canvas_draw_dot(canvas, left + 2 + col, top + 1 + row);
+                    }
+                }
+            }
+        }
+    }
+    for(int i = 0; i < snapshot->enemy_count; i++) {
+        canvas_draw_circle(
+            canvas,
+            snapshot->enemies[i].x * CELL_SIZE + CELL_SIZE / 2,
+            STATUS_BAR_HEIGHT + snapshot->enemies[i].y * CELL_SIZE + CELL_SIZE / 2,
+            3);
+    }
+    for(int p = 0; p < snapshot->projectile_count; p++) {
+        canvas_draw_dot(canvas, snapshot->projectiles[p].x, snapshot->projectiles[p].y);
+    }
+    canvas_draw_box(canvas, snapshot->cursor.x, snapshot->cursor.y, CELL_SIZE, CELL_SIZE);
+}
+
+/**
+ * @brief Frames blitted from the sprite atlas have exactly the pixels of the glyphs and
+ * circles drawn before it, over a game played with random key presses.
+ * @param game Scratch game state.
+ * @return True if the check passed.
+ */
+static bool check_sprite_frames(GameState* game) {
+    static const InputKey keys[] = {
+        InputKeyUp, InputKeyDown, InputKeyLeft, InputKeyRight, InputKeyOk};
+    Canvas* sprites = host_canvas_alloc_raster();
+    Canvas* reference = host_canvas_alloc_raster();
+    DrawContext* draw = malloc(sizeof(DrawContext));
+    if(!sprites || !reference || !draw) {
+        fprintf(stderr, "  out of memory\n");
+        return false;
+    }
+    init_game_state(game);
+    draw_context_init(draw);
+    uint32_t rng = 1;
+    bool ok = true;
+    int enemies_drawn = 0;
+    for(int frame = 0; frame < 20000 && ok; frame++) {
+        uint32_t r = host_xorshift32(&rng);
+        InputEvent input = {.key = keys[(r >> 8) % 5], .type = InputTypePress};
+        game_step(game, &input, r % 4 == 0);
+        draw_game(sprites, game, draw);
+        check_draw_reference(reference, &draw->snapshot);
+        enemies_drawn += draw->snapshot.enemy_count;
+        if(memcmp(host_canvas_pixels(sprites),
+                  host_canvas_pixels(reference),
+                  HOST_CANVAS_WIDTH * HOST_CANVAS_HEIGHT) != 0) {
+            fprintf(stderr, "  frame %d: pixels differ\n", frame);
+            ok = false;
+        }
+    }
+    // A game without enemies on screen would not test the enemy sprite
+    ok &= check_that(enemies_drawn > 0, "enemies on screen");
+    free(draw);
+    host_canvas_free(reference);
+    host_canvas_free(sprites);
+    return ok;
+}
+
+static const Check checks[] = {
+    {"stranded_enemy", check_stranded_enemy},
+    {"snapshot_round_trip", check_snapshot_round_trip},
+    {"snapshot_corrupt", check_snapshot_corrupt},
+    {"projectile_dots", check_projectile_dots},
+    {"sprite_frames", check_sprite_frames},
+};
+
+int main(void) {
+    GameState* game = malloc(sizeof(GameState));
+    if(!game) return 1;
+    int failed = 0;
+    for(size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        bool ok = checks[i].run(game);
+        printf("%s %s\n", ok ? "ok  " : "FAIL", checks[i].name);
+        failed += !ok;
+    }
+    free(game);
+    return failed ? 1 : 0;
+}
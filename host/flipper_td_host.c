@@ -0,0 +1,227 @@
+/*
+ * Headless driver for the flipper_td simulation core.
+ *
+ * Plays a scripted game through game_step() as fast as the CPU allows and
+ * reports the tick rate, so the tick loop can be profiled under perf:
+ *
+ *   make -C host && perf record ./host/flipper_td_host -t 10000000
+ *
+ * Runs can be recorded to a replay file and played back at full speed, which
+ * gives a fixed workload to time before and after a change:
+ *
+ *   ./host/flipper_td_host -t 1000000 -o run.replay
+ *   ./host/flipper_td_host -p run.replay
+ *
+ * With -f the scripted run is grouped into fast-forward frames the way the app
+ * does it, and the tick count the controller settles on is reported:
+ *
+ *   ./host/flipper_td_host -t 10000000 -f -r
+ *
+ * Snapshots can be saved at the end of a run and resumed by a later one. The
+ * state hash printed with -L or -S shows whether a resumed run matches:
+ *
+ *   ./host/flipper_td_host -t 2000 -S save.snapshot
+ *   ./host/flipper_td_host -t 0 -L save.snapshot
+ *
+ * A run resumed with -L can be recorded too, and plays back from the same snapshot:
+ *
+ *   ./host/flipper_td_host -t 1000000 -L save.snapshot -o resumed.replay
+ *   ./host/flipper_td_host -p resumed.replay -L save.snapshot
+ */
+#include "host.h"
+#include "../flipper_td.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+
+// Host replays are not limited by device RAM
+#define HOST_REPLAY_MAX_EVENTS (1 << 22)
+
+/**
+ * @brief Produces the scripted input for one tick: an occasional random key press.
+ * @param rng Pointer to the generator state.
+ * @param input The event to fill in.
+ * @return The number of events produced, 0 or 1.
+ */
+static size_t scripted_input(uint32_t* rng, InputEvent* input) {
+    static const InputKey keys[] = {
+        InputKeyUp, InputKeyDown, InputKeyLeft, InputKeyRight, InputKeyOk};
+    uint32_t r = host_xorshift32(rng);
+    if(r % 8 != 0) return 0;
+    input->key = keys[(r >> 8) % (sizeof(keys) / sizeof(keys[0]))];
+    input->type = InputTypePress;
+    input->sequence = r;
+    return 1;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-t ticks] [-s seed] [-r] [-f] [-P] [-L file] [-S file]\n", name);
+    fprintf(stderr, "       [-o file | -p file]\n");
+    fprintf(stderr, "  -t ticks  number of simulation ticks to run (default 1000000)\n");
+    fprintf(stderr, "  -s seed   seed for the scripted input (default 1)\n");
+    fprintf(stderr, "  -r        call draw_game() on a counting canvas after every tick\n");
+    fprintf(stderr, "  -f        fast-forward: run ticks in frames of TURBO_FRAME_BUDGET_MS,\n");
+    fprintf(stderr, "            drawing once per frame with -r\n");
+    fprintf(stderr, "  -P        log the profiler's last window and the scratch arena peak\n");
+    fprintf(stderr, "  -L file   resume from a snapshot instead of a new game; a replay\n");
+    fprintf(stderr, "            recorded with -L plays back with the same -L\n");
+    fprintf(stderr, "  -S file   save a snapshot at the end of the run\n");
+    fprintf(stderr, "  -o file   record the scripted run to a replay file\n");
+    fprintf(stderr, "  -p file   play back a replay file instead of the scripted run\n");
+}
+
+int main(int argc, char** argv) {
+    uint64_t ticks = 1000000;
+    uint32_t seed = 1;
+    bool render = false;
+    bool fast_forward = false;
+    bool profile = false;
+    const char* record_path = NULL;
+    const char* play_path = NULL;
+    const char* load_path = NULL;
+    const char* save_path = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "t:s:rfPL:S:o:p:h")) != -1) {
+        switch(opt) {
+        case 't':
+            ticks = strtoull(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            render = true;
+            break;
+        case 'f':
+            fast_forward = true;
+            break;
+        case 'P':
+            profile = true;
+            break;
+        case 'L':
+            load_path = optarg;
+            break;
+        case 'S':
+            save_path = optarg;
+            break;
+        case 'o':
+            record_path = optarg;
+            break;
+        case 'p':
+            play_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(seed == 0) seed = 1;
+
+    GameState* game = malloc(sizeof(GameState));
+    Canvas* canvas = host_canvas_alloc();
+    DrawContext* draw = malloc(sizeof(DrawContext));
+    Replay* replay = replay_alloc(HOST_REPLAY_MAX_EVENTS);
+    if(!game || !canvas || !draw || !replay) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    init_game_state(game);
+    if(load_path && !snapshot_load(game, load_path)) {
+        fprintf(stderr, "cannot load snapshot %s\n", load_path);
+        return 1;
+    }
+    draw_context_init(draw);
+
+    int status = 0;
+    uint64_t frames = 0;
+    Turbo turbo = {.enabled = fast_forward};
+    turbo_reset(&turbo, UINT32_MAX / 2);
+    uint64_t start = host_time_ns();
+    if(play_path) {
+        if(!replay_load(replay, play_path)) {
+            fprintf(stderr, "cannot load replay %s\n", play_path);
+            return 1;
+        }
+        start = host_time_ns();
+        bool match = replay_play(replay, game, load_path, render ? canvas : NULL, draw);
+        ticks = game->tick;
+        printf("replay=%s\n", match ? "match" : "MISMATCH");
+        status = match ? 0 : 2;
+    } else {
+        replay_begin(replay, game, load_path != NULL);
+        uint32_t rng = seed;
+        InputEvent input;
+        uint64_t frame_ticks = turbo.enabled ? turbo.ticks_per_frame : 1;
+        uint64_t frame_start = host_time_ns();
+        for(uint64_t t = 0; t < ticks; t++) {
+            size_t count = scripted_input(&rng, &input);
+            if(count && !replay_record(replay, game->tick, &input)) replay_finish(replay, game);
+            game_step(game, &input, count);
+            if(--frame_ticks > 0 && t + 1 < ticks) continue;
+
+            if(turbo.enabled) {
+                uint64_t frame_ns = host_time_ns() - frame_start;
+                if(frame_ns > UINT32_MAX) frame_ns = UINT32_MAX;
+                turbo_adjust(&turbo, (uint32_t)frame_ns, TURBO_FRAME_BUDGET_MS * 1000000u);
+            }
+            if(render) draw_game(canvas, game, draw);
+            frames++;
+            frame_ticks = turbo.enabled ? turbo.ticks_per_frame : 1;
+            frame_start = host_time_ns();
+        }
+    }
+    uint64_t elapsed = host_time_ns() - start;
+    if(record_path) {
+        replay_finish(replay, game);
+        if(!replay_save(replay, record_path)) {
+            fprintf(stderr, "cannot save replay %s\n", record_path);
+            status = 1;
+        }
+    }
+    if(save_path && !snapshot_save(game, save_path)) {
+        fprintf(stderr, "cannot save snapshot %s\n", save_path);
+        status = 1;
+    }
+
+    double seconds = elapsed / 1e9;
+    printf(
+        "ticks=%" PRIu64 " seconds=%.3f ticks_per_second=%.0f\n", ticks, seconds, ticks / seconds);
+    printf(
+        "wave=%d lives=%d gold=%d projectiles_dropped=%" PRIu32 "\n",
+        game->wave,
+        game->lives,
+        game->gold,
+        game->projectiles_dropped);
+    if(load_path || save_path) printf("state_hash=%08" PRIx32 "\n", game_state_hash(game));
+    if(turbo.enabled) {
+        printf(
+            "frames=%" PRIu64 " turbo_ticks_per_frame=%" PRIu32 "\n",
+            frames,
+            turbo.ticks_per_frame);
+    }
+    if(render) {
+        const HostCanvasStats* stats = host_canvas_stats(canvas);
+        printf(
+            "canvas str=%" PRIu64 " line=%" PRIu64 " circle=%" PRIu64 " dot=%" PRIu64
+            " box=%" PRIu64 " xbm=%" PRIu64 "\n",
+            stats->str,
+            stats->line,
+            stats->circle,
+            stats->dot,
+            stats->box,
+            stats->xbm);
+    }
+    if(profile) {
+        profiler_log(&game->profiler);
+        printf(
+            "scratch_peak=%zu scratch_size=%zu\n",
+            game->scratch.peak,
+            sizeof(game->scratch.bytes));
+    }
+
+    replay_free(replay);
+    host_canvas_free(canvas);
+    free(draw);
+    free(game);
+    return status;
+}
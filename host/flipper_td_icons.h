@@ -0,0 +1,4 @@
+/*
+ * Host stand-in for the icon header fbt generates from the images folder.
+ */
+#pragma once
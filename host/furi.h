@@ -0,0 +1,28 @@
+/*
+ * Minimal host stand-in for the Furi SDK header, just enough to build the
+ * simulation core of flipper_td on a normal Linux box. See host/Makefile.
+ */
+#ifndef FLIPPER_TD_HOST_FURI_H
+#define FLIPPER_TD_HOST_FURI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNUSED(x) (void)(x)
+#define furi_assert(x) ((void)(x))
+#define furi_check(x)  ((x) ? (void)0 : abort())
+
+#define FURI_LOG_E(tag, format, ...) fprintf(stderr, "[E][%s] " format "\n", tag, ##__VA_ARGS__)
+#define FURI_LOG_W(tag, format, ...) fprintf(stderr, "[W][%s] " format "\n", tag, ##__VA_ARGS__)
+#define FURI_LOG_I(tag, format, ...) fprintf(stderr, "[I][%s] " format "\n", tag, ##__VA_ARGS__)
+#define FURI_LOG_D(tag, format, ...) ((void)0)
+
+// Records are plain named singletons; every name maps to the same dummy instance
+void* furi_record_open(const char* name);
+void furi_record_close(const char* name);
+
+#endif // FLIPPER_TD_HOST_FURI_H
@@ -0,0 +1,27 @@
+/*
+ * Host stand-in for the Furi GUI header. Canvas calls only bump per-primitive
+ * counters, so rendering cost can be measured without a display.
+ */
+#ifndef FLIPPER_TD_HOST_GUI_H
+#define FLIPPER_TD_HOST_GUI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Canvas Canvas;
+
+void canvas_reset(Canvas* canvas);
+void canvas_draw_str(Canvas* canvas, int32_t x, int32_t y, const char* str);
+void canvas_draw_line(Canvas* canvas, int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+void canvas_draw_circle(Canvas* canvas, int32_t x, int32_t y, uint32_t radius);
+void canvas_draw_dot(Canvas* canvas, int32_t x, int32_t y);
+void canvas_draw_box(Canvas* canvas, int32_t x, int32_t y, uint32_t width, uint32_t height);
+void canvas_draw_xbm(
+    Canvas* canvas,
+    int32_t x,
+    int32_t y,
+    size_t width,
+    size_t height,
+    const uint8_t* bitmap);
+
+#endif // FLIPPER_TD_HOST_GUI_H
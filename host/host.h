@@ -0,0 +1,48 @@
+/*
+ * Host-only helpers that have no counterpart in the Furi SDK.
+ */
+#ifndef FLIPPER_TD_HOST_H
+#define FLIPPER_TD_HOST_H
+
+#include <gui/gui.h>
+#include <stdint.h>
+
+// Number of calls made to each canvas primitive since the canvas was allocated
+typedef struct {
+    uint64_t reset;
+    uint64_t str;
+    uint64_t line;
+    uint64_t circle;
+    uint64_t dot;
+    uint64_t box;
+    uint64_t xbm;
+} HostCanvasStats;
+
+// Screen size of a rasterizing canvas, one byte per pixel in host_canvas_pixels()
+#define HOST_CANVAS_WIDTH  128
+#define HOST_CANVAS_HEIGHT 64
+
+// A counting canvas only counts calls. A rasterizing canvas also sets the pixels that dots,
+// boxes, circles and XBMs cover, the way the Flipper's u8g2 does, so frames drawn in two ways
+// can be compared. Strings and lines are only counted.
+Canvas* host_canvas_alloc(void);
+Canvas* host_canvas_alloc_raster(void);
+void host_canvas_free(Canvas* canvas);
+const HostCanvasStats* host_canvas_stats(const Canvas* canvas);
+// Row-major pixels, 1 where set, or NULL for a counting canvas
+const uint8_t* host_canvas_pixels(const Canvas* canvas);
+
+// Monotonic clock in nanoseconds
+uint64_t host_time_ns(void);
+
+typedef struct GameState GameState;
+
+// Small xorshift generator, so scripted runs and generated states are reproducible from a
+// seed. The state must be non-zero.
+uint32_t host_xorshift32(uint32_t* state);
+
+// Adds random towers on free cells that keep every spawn connected to an exit, until density
+// percent of the grid holds towers or too many attempts fail. Returns the towers on the grid.
+int host_random_towers(GameState* game, uint32_t* rng, int density);
+
+#endif // FLIPPER_TD_HOST_H
@@ -0,0 +1,239 @@
+/*
+ * Host implementations of the Furi primitives used by the simulation core, and helpers
+ * shared by the host drivers.
+ */
+#include "host.h"
+#include "../flipper_td.h"
+
+#include <furi.h>
+#include <storage/storage.h>
+#include <errno.h>
+#include <time.h>
+
+struct Canvas {
+    HostCanvasStats stats;
+    uint8_t* pixels; // HOST_CANVAS_HEIGHT rows of HOST_CANVAS_WIDTH, NULL if only counting
+};
+
+Canvas* host_canvas_alloc(void) {
+    return calloc(1, sizeof(Canvas));
+}
+
+Canvas* host_canvas_alloc_raster(void) {
+    Canvas* canvas = host_canvas_alloc();
+    if(!canvas) return NULL;
+    canvas->pixels = calloc(HOST_CANVAS_HEIGHT, HOST_CANVAS_WIDTH);
+    if(!canvas->pixels) {
+        free(canvas);
+        return NULL;
+    }
+    return canvas;
+}
+
+void host_canvas_free(Canvas* canvas) {
+    free(canvas->pixels);
+    free(canvas);
+}
+
+const HostCanvasStats* host_canvas_stats(const Canvas* canvas) {
+    return &canvas->stats;
+}
+
+const uint8_t* host_canvas_pixels(const Canvas* canvas) {
+    return canvas->pixels;
+}
+
+/**
+ * @brief Sets one pixel of a rasterizing canvas, clipped to the screen.
+ * @param canvas The canvas.
+ * @param x The column.
+ * @param y The row.
+ */
+static void host_canvas_set(Canvas* canvas, int32_t x, int32_t y) {
+    if(!canvas->pixels || x < 0 || x >= HOST_CANVAS_WIDTH || y < 0 || y >= HOST_CANVAS_HEIGHT) {
+        return;
+    }
+    canvas->pixels[y * HOST_CANVAS_WIDTH + x] = 1;
+}
+
+void canvas_reset(Canvas* canvas) {
+    canvas->stats.reset++;
+    if(canvas->pixels) memset(canvas->pixels, 0, HOST_CANVAS_HEIGHT * HOST_CANVAS_WIDTH);
+}
+
+void canvas_draw_str(Canvas* canvas, int32_t x, int32_t y, const char* str) {
+    UNUSED(x);
+    UNUSED(y);
+    UNUSED(str);
+    canvas->stats.str++;
+}
+
+void canvas_draw_line(Canvas* canvas, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    UNUSED(x1);
+    UNUSED(y1);
+    UNUSED(x2);
+    UNUSED(y2);
+    canvas->stats.line++;
+}
+
+void canvas_draw_circle(Canvas* canvas, int32_t x, int32_t y, uint32_t radius) {
+    canvas->stats.circle++;
+    if(!canvas->pixels) return;
+    // u8g2's midpoint circle, drawn as eight mirrored octants
+    int32_t f = 1 - (int32_t)radius;
+    int32_t ddf_x = 1;
+    int32_t ddf_y = -2 * (int32_t)radius;
+    int32_t dx = 0;
+    int32_t dy = radius;
+    while(true) {
+        host_canvas_set(canvas, x + dx, y - dy);
+        host_canvas_set(canvas, x + dy, y - dx);
+        host_canvas_set(canvas, x - dx, y - dy);
+        host_canvas_set(canvas, x - dy, y - dx);
+        host_canvas_set(canvas, x + dx, y + dy);
+        host_canvas_set(canvas, x + dy, y + dx);
+        host_canvas_set(canvas, x - dx, y + dy);
+        host_canvas_set(canvas, x - dy, y + dx);
+        if(dx >= dy) break;
+        if(f >= 0) {
+            dy--;
+            ddf_y += 2;
+            f += ddf_y;
+        }
+        dx++;
+        ddf_x += 2;
+        f += ddf_x;
+    }
+}
+
+void canvas_draw_dot(Canvas* canvas, int32_t x, int32_t y) {
+    canvas->stats.dot++;
+    host_canvas_set(canvas, x, y);
+}
+
+void canvas_draw_box(Canvas* canvas, int32_t x, int32_t y, uint32_t width, uint32_t height) {
+    canvas->stats.box++;
+    if(!canvas->pixels) return;
+    for(uint32_t row = 0; row < height; row++) {
+        for(uint32_t col = 0; col < width; col++) {
+            host_canvas_set(canvas, x + col, y + row);
+        }
+    }
+}
+
+void canvas_draw_xbm(
+    Canvas* canvas,
+    int32_t x,
+    int32_t y,
+    size_t width,
+    size_t height,
+    const uint8_t* bitmap) {
+    canvas->stats.xbm++;
+    if(!canvas->pixels) return;
+    size_t stride = (width + 7) / 8;
+    for(size_t row = 0; row < height; row++) {
+        for(size_t col = 0; col < width; col++) {
+            if(bitmap[row * stride + col / 8] >> (col % 8) & 1) {
+                host_canvas_set(canvas, x + col, y + row);
+            }
+        }
+    }
+}
+
+uint64_t host_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t host_xorshift32(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+int host_random_towers(GameState* game, uint32_t* rng, int density) {
+    int towers = 0;
+    for(int x = 0; x < GRID_WIDTH; x++) {
+        for(int y = 0; y < GRID_HEIGHT; y++) {
+            towers += get_grid_cell(game, x, y) != TOWER_NONE;
+        }
+    }
+    int target = GRID_CELLS * density / 100;
+    // Bounded, since a dense target may not fit once the path is down to a single lane
+    for(int attempt = 0; towers < target && attempt < GRID_CELLS * 8; attempt++) {
+        int x = host_xorshift32(rng) % GRID_WIDTH;
+        int y = host_xorshift32(rng) % GRID_HEIGHT;
+        if(get_grid_cell(game, x, y) != TOWER_NONE || placement_blocks_path(game, x, y)) continue;
+        TowerType type = TOWER_NORMAL + host_xorshift32(rng) % (TOWER_FREEZE - TOWER_NONE);
+        set_grid_cell(game, x, y, type);
+        towers++;
+    }
+    return towers;
+}
+
+void* furi_record_open(const char* name) {
+    UNUSED(name);
+    static int record;
+    return &record;
+}
+
+void furi_record_close(const char* name) {
+    UNUSED(name);
+}
+
+struct File {
+    FILE* stream;
+};
+
+File* storage_file_alloc(Storage* storage) {
+    UNUSED(storage);
+    return calloc(1, sizeof(File));
+}
+
+void storage_file_free(File* file) {
+    storage_file_close(file);
+    free(file);
+}
+
+bool storage_file_open(
+    File* file,
+    const char* path,
+    FS_AccessMode access_mode,
+    FS_OpenMode open_mode) {
+    const char* mode = "rb";
+    if(access_mode & FSAM_WRITE) {
+        if(open_mode == FSOM_OPEN_APPEND) {
+            mode = "ab";
+        } else if(open_mode == FSOM_CREATE_ALWAYS) {
+            mode = access_mode & FSAM_READ ? "w+b" : "wb";
+        } else {
+            mode = "r+b";
+        }
+    }
+    file->stream = fopen(path, mode);
+    return file->stream != NULL;
+}
+
+bool storage_file_close(File* file) {
+    if(!file->stream) return false;
+    bool ok = fclose(file->stream) == 0;
+    file->stream = NULL;
+    return ok;
+}
+
+size_t storage_file_read(File* file, void* buff, size_t bytes_to_read) {
+    return file->stream ? fread(buff, 1, bytes_to_read, file->stream) : 0;
+}
+
+size_t storage_file_write(File* file, const void* buff, size_t bytes_to_write) {
+    return file->stream ? fwrite(buff, 1, bytes_to_write, file->stream) : 0;
+}
+
+bool storage_simply_remove(Storage* storage, const char* path) {
+    UNUSED(storage);
+    return remove(path) == 0 || errno == ENOENT;
+}
@@ -0,0 +1,34 @@
+/*
+ * Host stand-in for the Furi input service header.
+ */
+#ifndef FLIPPER_TD_HOST_INPUT_H
+#define FLIPPER_TD_HOST_INPUT_H
+
+#include <stdint.h>
+
+typedef enum {
+    InputKeyUp,
+    InputKeyDown,
+    InputKeyRight,
+    InputKeyLeft,
+    InputKeyOk,
+    InputKeyBack,
+    InputKeyMAX,
+} InputKey;
+
+typedef enum {
+    InputTypePress,
+    InputTypeRelease,
+    InputTypeShort,
+    InputTypeLong,
+    InputTypeRepeat,
+    InputTypeMAX,
+} InputType;
+
+typedef struct {
+    uint32_t sequence;
+    InputKey key;
+    InputType type;
+} InputEvent;
+
+#endif // FLIPPER_TD_HOST_INPUT_H
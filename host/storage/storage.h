@@ -0,0 +1,45 @@
+/*
+ * Host stand-in for the Furi storage API, backed by stdio files relative to
+ * the working directory.
+ */
+#ifndef FLIPPER_TD_HOST_STORAGE_H
+#define FLIPPER_TD_HOST_STORAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RECORD_STORAGE "storage"
+
+// On the host, app data lives in the working directory
+#define APP_DATA_PATH(path) path
+
+typedef struct Storage Storage;
+typedef struct File File;
+
+typedef enum {
+    FSAM_READ = (1 << 0),
+    FSAM_WRITE = (1 << 1),
+    FSAM_READ_WRITE = FSAM_READ | FSAM_WRITE,
+} FS_AccessMode;
+
+typedef enum {
+    FSOM_OPEN_EXISTING = 1,
+    FSOM_OPEN_ALWAYS = 2,
+    FSOM_OPEN_APPEND = 4,
+    FSOM_CREATE_NEW = 8,
+    FSOM_CREATE_ALWAYS = 16,
+} FS_OpenMode;
+
+File* storage_file_alloc(Storage* storage);
+void storage_file_free(File* file);
+bool storage_file_open(
+    File* file,
+    const char* path,
+    FS_AccessMode access_mode,
+    FS_OpenMode open_mode);
+bool storage_file_close(File* file);
+size_t storage_file_read(File* file, void* buff, size_t bytes_to_read);
+size_t storage_file_write(File* file, const void* buff, size_t bytes_to_write);
+bool storage_simply_remove(Storage* storage, const char* path);
+
+#endif // FLIPPER_TD_HOST_STORAGE_H